@@ -0,0 +1,406 @@
+///////////
+// BENCH //
+///////////
+
+// Benchmarks, in groups:
+//
+// - the intersection and optics routines, one call at a time, each named
+//   after its routine.
+// - whole frames of each generated scene in tests.c at increasing sizes, with
+//   each accelerator, named after the scene.
+// - threads, packets and paraxial: whole frames with increasing thread
+//   counts, with and without packet tracing, and with and without lens runs
+//   traced by transfer matrices.
+// - focus: focal point search on a lens stack with increasing ray counts.
+// - sweep: parameter sweeps of a lens stack with increasing thread counts.
+//
+// Every result is printed as one JSON object per line, so runs can be saved
+// and compared across commits:
+//
+//     make bench > bench.jsonl
+//
+// usage: ./build/bench [threads] [filter]
+//
+// Only benchmarks whose name contains `filter` are run.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/clock.c"
+#include "lib/random.c"
+#include "lib/threads.c"
+
+#include "constants.c"
+#include "lines.c"
+#include "optics.c"
+#include "components.c"
+#include "scene.c"
+#include "trace.c"
+#include "cache.c"
+#include "focus.c"
+#include "sweep.c"
+#include "tests.c"
+
+// Inputs the microbenchmarks cycle through, so each call sees different data
+// but everything stays in cache.
+typedef struct {
+    Ray *rays;
+    Line *lines;
+    Vector2 *normals;
+    Lines targets;
+    Lenses lenses;
+    Components components;
+    Bvh bvh;
+    Grid grid;
+    // keeps the results alive
+    f32 sink;
+} BenchInputs;
+
+typedef void (*BenchLoop)(BenchInputs *inputs, usize iterations);
+
+typedef struct {
+    char *name;
+    BenchLoop loop;
+} Bench;
+
+static Vector2 bench_point(Random *random) {
+    return (Vector2) { WIDTH * Random_F32(random), HEIGHT * Random_F32(random) };
+}
+
+static Line bench_line(Random *random, f32 length) {
+    Vector2 start = bench_point(random);
+    f32 angle = 2 * PI * Random_F32(random);
+    return (Line) { start, { start.x + length * cosf(angle), start.y + length * sinf(angle) } };
+}
+
+static void bench_inputs(BenchInputs *inputs, Arena *arena) {
+    Random random = Random_New(1);
+    *inputs = (BenchInputs) {
+        .rays = Arena_Alloc(arena, Ray, BENCH_INPUTS),
+        .lines = Arena_Alloc(arena, Line, BENCH_INPUTS),
+        .normals = Arena_Alloc(arena, Vector2, BENCH_INPUTS)
+    };
+    for (usize i = 0; i < BENCH_INPUTS; i++) {
+        inputs->rays[i] = Ray_FromAngle(bench_point(&random), 2 * PI * Random_F32(&random));
+        inputs->lines[i] = bench_line(&random, 400);
+        inputs->normals[i] = Line_Normal(inputs->lines + i);
+    }
+    for (usize i = 0; i < BENCH_TARGETS; i++) {
+        Line line = bench_line(&random, 100);
+        *List_Push(&inputs->targets, arena) = line;
+        *List_Push(&inputs->lenses, arena) = (Lens) { .line = line, .focal_length = 200 };
+        if (i % 2 == 0) Components_AddMirror(&inputs->components, &line, arena);
+        else Components_AddLens(&inputs->components, &line, 200, arena);
+    }
+    Bvh_Build(&inputs->bvh, &inputs->components, arena);
+    Grid_Build(&inputs->grid, &inputs->components, arena);
+}
+
+#define BENCH_MASK (BENCH_INPUTS - 1)
+
+static void bench_ray_line_intersect(BenchInputs *inputs, usize iterations) {
+    for (usize i = 0; i < iterations; i++) {
+        Vector2 point = ray_line_intersect(inputs->rays + (i & BENCH_MASK), inputs->lines + (i & BENCH_MASK));
+        inputs->sink += point.x;
+    }
+}
+
+static void bench_lines_intersect(BenchInputs *inputs, usize iterations) {
+    for (usize i = 0; i < iterations; i++) {
+        Vector2 point = lines_intersect(inputs->lines + (i & BENCH_MASK), inputs->lines + ((i + 1) & BENCH_MASK));
+        inputs->sink += point.x;
+    }
+}
+
+static void bench_rays_intersect(BenchInputs *inputs, usize iterations) {
+    for (usize i = 0; i < iterations; i++) {
+        Vector2 point = rays_intersect(inputs->rays + (i & BENCH_MASK), inputs->rays + ((i + 1) & BENCH_MASK));
+        inputs->sink += point.x;
+    }
+}
+
+static void bench_closest_intersection(BenchInputs *inputs, usize iterations) {
+    Vector2 point;
+    f32 distance;
+    for (usize i = 0; i < iterations; i++) {
+        closest_intersection(inputs->rays + (i & BENCH_MASK), &inputs->targets, &point, &distance);
+        inputs->sink += distance;
+    }
+}
+
+static void bench_closest_lens(BenchInputs *inputs, usize iterations) {
+    Vector2 point;
+    f32 distance;
+    for (usize i = 0; i < iterations; i++) {
+        closest_lens(inputs->rays + (i & BENCH_MASK), &inputs->lenses, &point, &distance);
+        inputs->sink += distance;
+    }
+}
+
+static void bench_closest_component(BenchInputs *inputs, usize iterations) {
+    Hit hit;
+    for (usize i = 0; i < iterations; i++) {
+        closest_component(inputs->rays + (i & BENCH_MASK), &inputs->components, &hit);
+        inputs->sink += hit.distance;
+    }
+}
+
+static void bench_bvh_closest(BenchInputs *inputs, usize iterations) {
+    Hit hit;
+    for (usize i = 0; i < iterations; i++) {
+        Bvh_Closest(&inputs->bvh, inputs->rays + (i & BENCH_MASK), &hit);
+        inputs->sink += hit.distance;
+    }
+}
+
+static void bench_grid_closest(BenchInputs *inputs, usize iterations) {
+    Hit hit;
+    for (usize i = 0; i < iterations; i++) {
+        Grid_Closest(&inputs->grid, inputs->rays + (i & BENCH_MASK), &hit);
+        inputs->sink += hit.distance;
+    }
+}
+
+static void bench_reflect_mirror(BenchInputs *inputs, usize iterations) {
+    for (usize i = 0; i < iterations; i++) {
+        Vector2 direction = reflect_mirror(inputs->rays + (i & BENCH_MASK), inputs->normals + (i & BENCH_MASK));
+        inputs->sink += direction.x;
+    }
+}
+
+static void bench_refract_lens(BenchInputs *inputs, usize iterations) {
+    for (usize i = 0; i < iterations; i++) {
+        Line *line = inputs->lines + (i & BENCH_MASK);
+        Vector2 center = Vector2_Average(&line->start, &line->end);
+        Vector2 direction = refract_lens(inputs->rays + (i & BENCH_MASK), inputs->normals + (i & BENCH_MASK), &center, &line->start, 200);
+        inputs->sink += direction.x;
+    }
+}
+
+// Runs `loop` with doubling iteration counts until one run takes at least
+// BENCH_MIN_TIME. Returns nanoseconds per iteration of that run.
+static f64 bench_measure(BenchLoop loop, BenchInputs *inputs, usize *iterations) {
+    for (usize count = BENCH_INPUTS;; count *= 2) {
+        f64 start = Clock_Now();
+        loop(inputs, count);
+        f64 elapsed = Clock_Now() - start;
+        if (elapsed >= BENCH_MIN_TIME) {
+            *iterations = count;
+            return elapsed * 1e9 / count;
+        }
+    }
+}
+
+// Traces full frames of a generated scene and prints one result line.
+static void bench_frame(char *name, TestScene generate, usize size, usize threads, Accelerator accelerator, bool packets, bool paraxial) {
+    Arena arena = { 0 };
+    Arena frame = { 0 };
+    Scene scene = Scene_New();
+    scene.accelerator = accelerator;
+    scene.paraxial.enabled = paraxial;
+    Random random = Random_New(size);
+    generate(&scene, size, BENCH_RAYS, &random);
+
+    Tracer tracer;
+    Tracer_Init(&tracer, threads, &arena);
+    tracer.packets = packets;
+    LightLines light_lines = { 0 };
+    TraceStats stats = { 0 };
+
+    // the first frame builds the accelerator
+    f64 build_start = Clock_Now();
+    Tracer_Trace(&tracer, &scene, &light_lines, &stats, &frame);
+    f64 first_frame = Clock_Now() - build_start;
+    usize segments = light_lines.length;
+
+    usize frames = 0;
+    f64 start = Clock_Now();
+    f64 elapsed = 0;
+    while (elapsed < BENCH_MIN_TIME) {
+        Arena_Reset(&frame);
+        light_lines = (LightLines) { 0 };
+        Tracer_Trace(&tracer, &scene, &light_lines, &stats, &frame);
+        frames++;
+        elapsed = Clock_Now() - start;
+    }
+
+    printf("{\"bench\": \"frame\", \"name\": \"%s\", \"accelerator\": \"%s\", \"packets\": %s, \"paraxial\": %s, \"components\": %zu, \"rays\": %zu, "
+        "\"threads\": %zu, \"segments\": %zu, \"frames\": %zu, \"first_frame_ms\": %.3f, \"ns_per_frame\": %.0f, "
+        "\"rays_per_sec\": %.0f, \"segments_per_sec\": %.0f}\n",
+        name, ACCELERATOR_NAMES[accelerator], packets ? "true" : "false", paraxial ? "true" : "false",
+        scene.components.length, scene.light_rays.length, threads,
+        segments, frames, first_frame * 1e3, elapsed * 1e9 / frames,
+        scene.light_rays.length * frames / elapsed, segments * frames / elapsed);
+    fflush(stdout);
+
+    Tracer_Free(&tracer);
+    Scene_Free(&scene);
+    Arena_Free(&frame);
+    Arena_Free(&arena);
+}
+
+// Finds the focal points of a lens stack over and over and prints one result
+// line. Tracing is left out: the cache is filled once beforehand.
+static void bench_focus(usize rays, usize threads) {
+    Arena arena = { 0 };
+    Arena frame = { 0 };
+    Scene scene = Scene_New();
+    Random random = Random_New(rays);
+    test_lens_stack(&scene, BENCH_MIN_SIZE, rays, &random);
+
+    Tracer tracer;
+    Tracer_Init(&tracer, threads, &arena);
+    TraceCache cache = { 0 };
+    LightLines light_lines = { 0 };
+    TraceCache_Update(&cache, &tracer, &scene, &light_lines, &frame);
+    Focus focus;
+    Focus_Init(&focus, &tracer.pool, &arena);
+
+    usize runs = 0;
+    f64 start = Clock_Now();
+    f64 elapsed = 0;
+    while (elapsed < BENCH_MIN_TIME) {
+        Focus_Begin(&focus);
+        Focus_AddCache(&focus, &scene, &cache);
+        Focus_Run(&focus);
+        runs++;
+        elapsed = Clock_Now() - start;
+    }
+
+    printf("{\"bench\": \"focus\", \"rays\": %zu, \"threads\": %zu, \"segments\": %zu, \"binned\": %zu, "
+        "\"crossings\": %zu, \"points\": %zu, \"runs\": %zu, \"ns_per_run\": %.0f}\n",
+        scene.light_rays.length, threads, focus.segments.length, focus.binned.length,
+        focus.crossing_count, focus.points.length, runs, elapsed * 1e9 / runs);
+    fflush(stdout);
+
+    Focus_Free(&focus);
+    TraceCache_Free(&cache);
+    Tracer_Free(&tracer);
+    Scene_Free(&scene);
+    Arena_Free(&frame);
+    Arena_Free(&arena);
+}
+
+// Sweeps the focal length of one lens of a lens stack and prints one result
+// line. Every worker generates the same scene, as Sweep_Load would load it.
+static void bench_sweep(usize size, usize threads) {
+    Arena arena = { 0 };
+    Line target = { { WIDTH - 100, 0 }, { WIDTH - 100, HEIGHT } };
+    Sweep sweep;
+    Sweep_Init(&sweep, threads, &target, &arena);
+    for (usize i = 0; i < sweep.pool.count; i++) {
+        Random random = Random_New(size);
+        test_lens_stack(&sweep.workers[i].scene, size, BENCH_RAYS, &random);
+    }
+    SweepParameter parameter = { .kind = SWEEP_FOCAL_LENGTH, .from.x = 100, .to.x = 500, .steps = BENCH_SWEEP_VARIANTS };
+    Sweep_AddParameter(&sweep, &parameter);
+
+    f64 start = Clock_Now();
+    Sweep_Run(&sweep);
+    f64 elapsed = Clock_Now() - start;
+
+    printf("{\"bench\": \"sweep\", \"components\": %zu, \"rays\": %zu, \"threads\": %zu, \"variants\": %zu, "
+        "\"ns_per_variant\": %.0f, \"variants_per_sec\": %.0f}\n",
+        sweep.workers[0].scene.components.length, sweep.workers[0].scene.light_rays.length, threads,
+        sweep.variant_count, elapsed * 1e9 / sweep.variant_count, sweep.variant_count / elapsed);
+    fflush(stdout);
+
+    Sweep_Free(&sweep);
+    Arena_Free(&arena);
+}
+
+i32 main(i32 argc, char **argv) {
+    usize threads = argc > 1 ? (usize) atoi(argv[1]) : Threads_Count();
+    char *filter = argc > 2 ? argv[2] : "";
+    if (threads == 0) {
+        fprintf(stderr, "threads must be positive\n");
+        return 1;
+    }
+
+    Arena arena = { 0 };
+    BenchInputs inputs;
+    bench_inputs(&inputs, &arena);
+    Segments_Kernel();
+
+    Bench micro[] = {
+        { "ray_line_intersect", bench_ray_line_intersect },
+        { "lines_intersect", bench_lines_intersect },
+        { "rays_intersect", bench_rays_intersect },
+        { "closest_intersection", bench_closest_intersection },
+        { "closest_lens", bench_closest_lens },
+        { "closest_component", bench_closest_component },
+        { "bvh_closest", bench_bvh_closest },
+        { "grid_closest", bench_grid_closest },
+        { "reflect_mirror", bench_reflect_mirror },
+        { "refract_lens", bench_refract_lens }
+    };
+    for (usize i = 0; i < sizeof(micro) / sizeof(*micro); i++) {
+        if (!strstr(micro[i].name, filter)) continue;
+        usize iterations;
+        f64 ns = bench_measure(micro[i].loop, &inputs, &iterations);
+        // the closest-hit queries scan BENCH_TARGETS lines per call
+        printf("{\"bench\": \"micro\", \"name\": \"%s\", \"iterations\": %zu, \"targets\": %zu, \"ns_per_op\": %.2f}\n",
+            micro[i].name, iterations, (usize) BENCH_TARGETS, ns);
+        fflush(stdout);
+    }
+
+    // scaling with scene size, for each accelerator; brute force only while
+    // it finishes in reasonable time
+    for (usize i = 0; i < TEST_SCENE_COUNT; i++) {
+        if (!strstr(TEST_SCENES[i].name, filter)) continue;
+        for (Accelerator accelerator = 0; accelerator < ACCELERATOR_COUNT; accelerator++) {
+            usize max_size = accelerator == ACCELERATOR_BRUTE ? BENCH_BRUTE_MAX_SIZE : BENCH_MAX_SIZE;
+            for (usize size = BENCH_MIN_SIZE; size <= max_size; size *= 4) {
+                bench_frame(TEST_SCENES[i].name, TEST_SCENES[i].generate, size, threads, accelerator, true, false);
+            }
+        }
+    }
+
+    // scaling with threads
+    if (strstr("threads", filter)) {
+        for (usize count = 1;; count = count * 2 < threads ? count * 2 : threads) {
+            bench_frame("threads", test_random_mirrors, BENCH_THREADS_SIZE, count, ACCELERATOR_BVH, true, false);
+            if (count == threads) break;
+        }
+    }
+
+    // packets against one ray at a time, on a beam
+    if (strstr("packets", filter)) {
+        for (usize size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE; size *= 4) {
+            bench_frame("packets", test_beam, size, threads, ACCELERATOR_BVH, false, false);
+            bench_frame("packets", test_beam, size, threads, ACCELERATOR_BVH, true, false);
+        }
+    }
+
+    // lens runs traced by their matrices against lens by lens
+    if (strstr("paraxial", filter)) {
+        for (usize size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE; size *= 4) {
+            bench_frame("paraxial", test_lens_stack, size, threads, ACCELERATOR_BVH, true, false);
+            bench_frame("paraxial", test_lens_stack, size, threads, ACCELERATOR_BVH, true, true);
+        }
+    }
+
+    // focal point search, which pairs up segments, against the rays behind it
+    if (strstr("focus", filter)) {
+        for (usize rays = BENCH_RAYS; rays <= BENCH_FOCUS_MAX_RAYS; rays *= 4) {
+            bench_focus(rays, threads);
+        }
+    }
+
+    // variants of one scene, one per task, with scaling in threads
+    if (strstr("sweep", filter)) {
+        for (usize count = 1;; count = count * 2 < threads ? count * 2 : threads) {
+            bench_sweep(BENCH_MIN_SIZE, count);
+            if (count == threads) break;
+        }
+    }
+
+    fprintf(stderr, "sink: %g\n", inputs.sink);
+    Arena_Free(&arena);
+    return 0;
+}
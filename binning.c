@@ -0,0 +1,109 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+#include "lib/types.c"
+#include "lib/vectors.c"
+#include "constants.c"
+#include "lines.c"
+
+// Binning of line segments into a uniform grid of square cells, for the grid
+// accelerator (grid.c) and focal point search (focus.c). Binning takes two
+// passes over the same lines: Binning_Count counts how many lines each cell
+// gets and turns the counts into where each cell's lines start, then the
+// caller sizes its output and Binning_Place hands out a slot per cell of each
+// line, leaving cell c with the slots [cells[c], cells[c + 1]).
+
+// Cell (column, row) covers [min + (column, row) * cell_size, min + (column +
+// 1, row + 1) * cell_size). A line is binned into every cell it passes within
+// `margin` of, so a point right on a cell border is found from either side.
+typedef struct {
+    Vector2 min;
+    f32 cell_size;
+    u32 columns;
+    u32 rows;
+    f32 margin;
+} Binning;
+
+// The line of item `item`, or NULL to leave it out.
+typedef Line *(*BinningLine)(void *context, usize item);
+
+// Stores item `item` at `slot`.
+typedef void (*BinningPlace)(void *context, usize item, u32 slot);
+
+i32 Binning_Clamp(f32 value, u32 limit) {
+    if (!(value >= 0)) return 0;
+    if (value >= limit) return limit - 1;
+    return value;
+}
+
+// Visits every cell `line` passes through, a row at a time. With no `place`
+// it counts the line into `cells[c]`; with one it places the line at
+// `cells[c]++`.
+static void Binning_Visit(Binning *binning, Line *line, u32 *cells, usize item, BinningPlace place, void *context) {
+    Vector2 delta = Vector2_Subtract(&line->end, &line->start);
+    f32 margin = binning->margin;
+    f32 min_y = fminf(line->start.y, line->end.y) - margin;
+    f32 max_y = fmaxf(line->start.y, line->end.y) + margin;
+    f32 inverse = 1 / binning->cell_size;
+    i32 first_row = Binning_Clamp((min_y - binning->min.y) * inverse, binning->rows);
+    i32 last_row = Binning_Clamp((max_y - binning->min.y) * inverse, binning->rows);
+
+    for (i32 row = first_row; row <= last_row; row++) {
+        // the part of the line inside the row, widened by the margin
+        f32 low = 0, high = 1;
+        if (fabsf(delta.y) > EPSILON) {
+            f32 y_0 = binning->min.y + row * binning->cell_size - margin;
+            f32 t_0 = (y_0 - line->start.y) / delta.y;
+            f32 t_1 = (y_0 + binning->cell_size + 2 * margin - line->start.y) / delta.y;
+            low = fmaxf(0, fminf(t_0, t_1));
+            high = fminf(1, fmaxf(t_0, t_1));
+            if (low > high) continue;
+        }
+        f32 x_0 = line->start.x + delta.x * low;
+        f32 x_1 = line->start.x + delta.x * high;
+        i32 first_column = Binning_Clamp((fminf(x_0, x_1) - margin - binning->min.x) * inverse, binning->columns);
+        i32 last_column = Binning_Clamp((fmaxf(x_0, x_1) + margin - binning->min.x) * inverse, binning->columns);
+
+        for (i32 column = first_column; column <= last_column; column++) {
+            u32 *cell = cells + row * binning->columns + column;
+            if (place) place(context, item, *cell);
+            (*cell)++;
+        }
+    }
+}
+
+// Counts the lines of `count` items into `cells`, which must hold one more
+// entry than there are cells, and returns how many slots they take in all.
+u32 Binning_Count(Binning *binning, u32 *cells, usize count, BinningLine line, void *context) {
+    usize cell_count = (usize) binning->columns * binning->rows;
+    memset(cells, 0, (cell_count + 1) * sizeof(u32));
+    for (usize i = 0; i < count; i++) {
+        Line *item_line = line(context, i);
+        if (item_line) Binning_Visit(binning, item_line, cells, i, NULL, context);
+    }
+
+    // counts to starts
+    u32 total = 0;
+    for (usize c = 0; c < cell_count; c++) {
+        u32 cell = cells[c];
+        cells[c] = total;
+        total += cell;
+    }
+    cells[cell_count] = total;
+    return total;
+}
+
+// Places the same items as the last Binning_Count into their slots.
+void Binning_Place(Binning *binning, u32 *cells, usize count, BinningLine line, BinningPlace place, void *context) {
+    for (usize i = 0; i < count; i++) {
+        Line *item_line = line(context, i);
+        if (item_line) Binning_Visit(binning, item_line, cells, i, place, context);
+    }
+
+    // placing moved every start to the next cell's start
+    usize cell_count = (usize) binning->columns * binning->rows;
+    for (usize c = cell_count; c > 0; c--) cells[c] = cells[c - 1];
+    cells[0] = 0;
+}
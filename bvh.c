@@ -0,0 +1,457 @@
+#pragma once
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/vectors.c"
+#include "constants.c"
+#include "lines.c"
+#include "components.c"
+#include "segments.c"
+
+// Bounding volume hierarchy over every component in a scene, so the closest
+// hit of a ray costs roughly log(components) tests instead of one test per
+// component. Leaves are tested with the SIMD kernels in segments.c against an
+// SoA copy of the primitives.
+
+typedef struct {
+    Line line;
+    ComponentKind kind;
+    u32 index;
+} BvhPrimitive;
+
+// Interior nodes keep their two children next to each other starting at
+// `first`; leaves own `count` primitives starting at `first`.
+typedef struct {
+    Vector2 min;
+    Vector2 max;
+    u32 first;
+    u32 count;
+} BvhNode;
+
+typedef struct {
+    BvhNode *data;
+    usize length;
+    usize capacity;
+} BvhNodes;
+
+typedef struct {
+    BvhPrimitive *data;
+    usize length;
+    usize capacity;
+} BvhPrimitives;
+
+typedef struct {
+    u32 *data;
+    usize length;
+    usize capacity;
+} BvhSlots;
+
+// Between builds, components are inserted into and removed from the tree in
+// place (see Bvh_Update and Bvh_Remove). `stale` counts those edits, and once
+// they make up too much of the tree it is rebuilt. Removed components leave a
+// zero-length primitive of kind COMPONENT_NONE behind, which never gets hit.
+typedef struct {
+    BvhNodes nodes;
+    BvhPrimitives primitives;
+    Segments segments;
+    // primitive of each component
+    BvhSlots slots;
+    usize component_count;
+    usize stale;
+    bool built;
+    bool refit;
+} Bvh;
+
+static Vector2 BvhPrimitive_Centroid(BvhPrimitive *primitive) {
+    return Vector2_Average(&primitive->line.start, &primitive->line.end);
+}
+
+static void BvhNode_Fit(BvhNode *node, BvhPrimitive *primitives) {
+    node->min = (Vector2) { FLT_MAX, FLT_MAX };
+    node->max = (Vector2) { -FLT_MAX, -FLT_MAX };
+    for (u32 i = node->first; i < node->first + node->count; i++) {
+        Line *line = &primitives[i].line;
+        node->min.x = fminf(node->min.x, fminf(line->start.x, line->end.x));
+        node->min.y = fminf(node->min.y, fminf(line->start.y, line->end.y));
+        node->max.x = fmaxf(node->max.x, fmaxf(line->start.x, line->end.x));
+        node->max.y = fmaxf(node->max.y, fmaxf(line->start.y, line->end.y));
+    }
+}
+
+static int BvhPrimitive_CompareX(const void *a, const void *b) {
+    f32 x_a = BvhPrimitive_Centroid((BvhPrimitive *) a).x;
+    f32 x_b = BvhPrimitive_Centroid((BvhPrimitive *) b).x;
+    return (x_a > x_b) - (x_a < x_b);
+}
+
+static int BvhPrimitive_CompareY(const void *a, const void *b) {
+    f32 y_a = BvhPrimitive_Centroid((BvhPrimitive *) a).y;
+    f32 y_b = BvhPrimitive_Centroid((BvhPrimitive *) b).y;
+    return (y_a > y_b) - (y_a < y_b);
+}
+
+// Splits a node at the median centroid along its longest axis.
+static void Bvh_Split(Bvh *bvh, usize node_index, Arena *arena) {
+    BvhNode *node = bvh->nodes.data + node_index;
+    if (node->count <= BVH_LEAF_SIZE) return;
+
+    u32 first = node->first;
+    u32 count = node->count;
+    bool split_x = node->max.x - node->min.x > node->max.y - node->min.y;
+    qsort(bvh->primitives.data + first, count, sizeof(BvhPrimitive),
+        split_x ? BvhPrimitive_CompareX : BvhPrimitive_CompareY);
+
+    u32 left_count = count / 2;
+    u32 children = bvh->nodes.length;
+    *List_Push(&bvh->nodes, arena) = (BvhNode) { .first = first, .count = left_count };
+    *List_Push(&bvh->nodes, arena) = (BvhNode) { .first = first + left_count, .count = count - left_count };
+
+    // pushing may have moved the node array
+    node = bvh->nodes.data + node_index;
+    node->first = children;
+    node->count = 0;
+
+    BvhNode_Fit(bvh->nodes.data + children, bvh->primitives.data);
+    BvhNode_Fit(bvh->nodes.data + children + 1, bvh->primitives.data);
+    Bvh_Split(bvh, children, arena);
+    Bvh_Split(bvh, children + 1, arena);
+}
+
+// Rebuilds the hierarchy from scratch, reusing the memory of the last build.
+void Bvh_Build(Bvh *bvh, Components *components, Arena *arena) {
+    bvh->nodes.length = 0;
+    bvh->primitives.length = 0;
+
+    for (usize i = 0; i < components->length; i++) {
+        Component *component = Components_Get(components, i);
+        *List_Push(&bvh->primitives, arena) = (BvhPrimitive) {
+            .line = component->line,
+            .kind = component->kind,
+            .index = i
+        };
+    }
+
+    *List_Push(&bvh->nodes, arena) = (BvhNode) { .first = 0, .count = bvh->primitives.length };
+    BvhNode_Fit(bvh->nodes.data, bvh->primitives.data);
+    Bvh_Split(bvh, 0, arena);
+
+    Segments_Resize(&bvh->segments, bvh->primitives.length, arena);
+    bvh->slots.length = 0;
+    List_Reserve(&bvh->slots, bvh->primitives.length, arena);
+    bvh->slots.length = bvh->primitives.length;
+    for (usize i = 0; i < bvh->primitives.length; i++) {
+        Segments_Set(&bvh->segments, i, &bvh->primitives.data[i].line);
+        bvh->slots.data[bvh->primitives.data[i].index] = i;
+    }
+
+    bvh->component_count = components->length;
+    bvh->stale = 0;
+    bvh->built = true;
+    bvh->refit = false;
+}
+
+// Recomputes bounds after components moved without changing the tree shape.
+// Children always come after their parent, so walking backwards visits them
+// first.
+void Bvh_Refit(Bvh *bvh, Components *components) {
+    for (usize i = 0; i < bvh->primitives.length; i++) {
+        BvhPrimitive *primitive = bvh->primitives.data + i;
+        if (primitive->kind == COMPONENT_NONE) continue;
+        primitive->line = Components_Get(components, primitive->index)->line;
+        Segments_Set(&bvh->segments, i, &primitive->line);
+    }
+
+    for (usize i = bvh->nodes.length; i-- > 0;) {
+        BvhNode *node = bvh->nodes.data + i;
+        if (node->count > 0) {
+            BvhNode_Fit(node, bvh->primitives.data);
+            continue;
+        }
+
+        BvhNode *left = bvh->nodes.data + node->first;
+        BvhNode *right = left + 1;
+        node->min = (Vector2) { fminf(left->min.x, right->min.x), fminf(left->min.y, right->min.y) };
+        node->max = (Vector2) { fmaxf(left->max.x, right->max.x), fmaxf(left->max.y, right->max.y) };
+    }
+
+    bvh->refit = false;
+}
+
+// How much the perimeter of `node` grows if it has to hold `line` as well.
+static f32 BvhNode_Growth(BvhNode *node, Line *line) {
+    f32 min_x = fminf(node->min.x, fminf(line->start.x, line->end.x));
+    f32 min_y = fminf(node->min.y, fminf(line->start.y, line->end.y));
+    f32 max_x = fmaxf(node->max.x, fmaxf(line->start.x, line->end.x));
+    f32 max_y = fmaxf(node->max.y, fmaxf(line->start.y, line->end.y));
+    return (max_x - min_x + max_y - min_y) - (node->max.x - node->min.x + node->max.y - node->min.y);
+}
+
+// Adds the next component to the tree: walks down to the leaf whose box grows
+// least and splits it into itself and a new leaf holding just the component.
+// The ancestors' bounds are left to the next refit.
+static void Bvh_Insert(Bvh *bvh, Components *components, Arena *arena) {
+    usize index = bvh->component_count++;
+    Component *component = Components_Get(components, index);
+    u32 primitive = bvh->primitives.length;
+    *List_Push(&bvh->primitives, arena) = (BvhPrimitive) {
+        .line = component->line,
+        .kind = component->kind,
+        .index = index
+    };
+    *List_Push(&bvh->slots, arena) = primitive;
+
+    usize capacity = bvh->segments.capacity;
+    Segments_Resize(&bvh->segments, bvh->primitives.length, arena);
+    // a grown list starts out empty
+    usize first = bvh->segments.capacity == capacity ? primitive : 0;
+    for (usize i = first; i < bvh->primitives.length; i++) {
+        Segments_Set(&bvh->segments, i, &bvh->primitives.data[i].line);
+    }
+
+    u32 node_index = 0;
+    u32 depth = 0;
+    while (bvh->nodes.data[node_index].count == 0) {
+        BvhNode *left = bvh->nodes.data + bvh->nodes.data[node_index].first;
+        bool go_left = BvhNode_Growth(left, &component->line) <= BvhNode_Growth(left + 1, &component->line);
+        node_index = bvh->nodes.data[node_index].first + (go_left ? 0 : 1);
+        depth++;
+    }
+
+    BvhNode leaf = bvh->nodes.data[node_index];
+    u32 children = bvh->nodes.length;
+    *List_Push(&bvh->nodes, arena) = leaf;
+    *List_Push(&bvh->nodes, arena) = (BvhNode) { .first = primitive, .count = 1 };
+    BvhNode_Fit(bvh->nodes.data + children + 1, bvh->primitives.data);
+    bvh->nodes.data[node_index] = (BvhNode) { .min = leaf.min, .max = leaf.max, .first = children, .count = 0 };
+
+    bvh->stale++;
+    bvh->refit = true;
+    // keep within the traversal stack of Bvh_Closest
+    if (depth + 1 >= BVH_MAX_DEPTH) bvh->built = false;
+}
+
+// Takes component `index` out of the tree, after the last component (`last`)
+// was moved into its place.
+void Bvh_Remove(Bvh *bvh, usize index, usize last) {
+    if (!bvh->built) return;
+    if (last >= bvh->component_count) {
+        // components added since the last update are not in the tree yet
+        bvh->built = false;
+        return;
+    }
+
+    BvhPrimitive *removed = bvh->primitives.data + bvh->slots.data[index];
+    removed->kind = COMPONENT_NONE;
+    removed->line.end = removed->line.start;
+    Segments_Set(&bvh->segments, bvh->slots.data[index], &removed->line);
+
+    u32 moved = bvh->slots.data[last];
+    bvh->primitives.data[moved].index = index;
+    bvh->slots.data[index] = moved;
+    bvh->slots.length--;
+
+    bvh->component_count--;
+    bvh->stale++;
+}
+
+// Brings the tree up to date with `components`: inserts the ones added since
+// the last update, refits after moves, and rebuilds from scratch when there
+// is no tree yet or edits have made up too much of it.
+void Bvh_Update(Bvh *bvh, Components *components, Arena *arena) {
+    while (bvh->built && bvh->primitives.length > 0 && bvh->component_count < components->length) {
+        Bvh_Insert(bvh, components, arena);
+    }
+
+    if (!bvh->built || bvh->component_count != components->length || 2 * bvh->stale > bvh->primitives.length) {
+        Bvh_Build(bvh, components, arena);
+        return;
+    }
+    if (bvh->refit) Bvh_Refit(bvh, components);
+}
+
+// fminf and fmaxf, written out so they compile to a couple of instructions
+// instead of library calls: a NaN (from 0 * inf on a box edge) loses to a
+// number.
+static inline f32 bvh_min(f32 a, f32 b) {
+    return a < b || b != b ? a : b;
+}
+
+static inline f32 bvh_max(f32 a, f32 b) {
+    return a > b || b != b ? a : b;
+}
+
+// Distance along the ray to the node's box, or FLT_MAX if it misses.
+static f32 BvhNode_Distance(BvhNode *node, Vector2 *start, Vector2 *inverse) {
+    f32 t_x1 = (node->min.x - start->x) * inverse->x;
+    f32 t_x2 = (node->max.x - start->x) * inverse->x;
+    f32 t_y1 = (node->min.y - start->y) * inverse->y;
+    f32 t_y2 = (node->max.y - start->y) * inverse->y;
+
+    f32 t_min = bvh_max(bvh_min(t_x1, t_x2), bvh_min(t_y1, t_y2));
+    f32 t_max = bvh_min(bvh_max(t_x1, t_x2), bvh_max(t_y1, t_y2));
+    if (t_max < 0 || t_min > t_max) return FLT_MAX;
+    return bvh_max(t_min, 0);
+}
+
+// Finds the nearest component hit by `ray`. Returns false and leaves
+// `hit->kind` as COMPONENT_NONE if nothing is hit.
+bool Bvh_Closest(Bvh *bvh, Ray *ray, Hit *hit) {
+    *hit = (Hit) { .kind = COMPONENT_NONE, .index = (usize) -1, .point = { NAN, NAN }, .distance = FLT_MAX };
+    if (bvh->primitives.length == 0) return false;
+
+    SegmentsKernel kernel = Segments_Kernel();
+    Vector2 direction = Ray_ToVector(ray);
+    Vector2 inverse = { 1.0 / direction.x, 1.0 / direction.y };
+
+    u32 stack[64];
+    u32 top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        BvhNode *node = bvh->nodes.data + stack[--top];
+        if (BvhNode_Distance(node, &ray->start, &inverse) >= hit->distance) continue;
+
+        if (node->count > 0) {
+            hit->tests += node->count;
+            usize i = kernel(&bvh->segments, node->first, node->count, &ray->start, &direction, &hit->distance);
+            if (i != (usize) -1) {
+                hit->kind = bvh->primitives.data[i].kind;
+                hit->index = bvh->primitives.data[i].index;
+            }
+            continue;
+        }
+
+        // visit the nearer child first so the farther one is more likely culled
+        BvhNode *left = bvh->nodes.data + node->first;
+        f32 left_distance = BvhNode_Distance(left, &ray->start, &inverse);
+        f32 right_distance = BvhNode_Distance(left + 1, &ray->start, &inverse);
+        if (left_distance < right_distance) {
+            stack[top++] = node->first + 1;
+            stack[top++] = node->first;
+        } else {
+            stack[top++] = node->first;
+            stack[top++] = node->first + 1;
+        }
+    }
+
+    if (hit->kind == COMPONENT_NONE) return false;
+    hit->point = (Vector2) {
+        ray->start.x + direction.x * hit->distance,
+        ray->start.y + direction.y * hit->distance
+    };
+    return true;
+}
+
+// Extent of the node's box along the unit vector `axis`.
+static void BvhNode_Project(BvhNode *node, Vector2 *axis, f32 *low, f32 *high) {
+    f32 center = 0.5f * ((node->min.x + node->max.x) * axis->x + (node->min.y + node->max.y) * axis->y);
+    f32 radius = 0.5f * ((node->max.x - node->min.x) * fabsf(axis->x) + (node->max.y - node->min.y) * fabsf(axis->y));
+    *low = center - radius;
+    *high = center + radius;
+}
+
+// Finds the nearest component hit by each of `count` rays heading about the
+// same way, as Bvh_Closest would, but walks the tree once for all of them.
+// Each node is first tested against the whole packet in the frame of the
+// first ray's direction: the rays sweep a band across that direction, widened
+// by how far they fan apart over the node's distance, and a node outside the
+// band, behind every start or past every ray's closest hit so far is skipped
+// for all of them. Leaves that pass are tested ray by ray.
+void Bvh_ClosestPacket(Bvh *bvh, Ray **rays, u32 count, Hit *hits) {
+    if (count > TRACE_PACKET_SIZE) { raise(SIGTRAP); }
+    for (u32 m = 0; m < count; m++) {
+        hits[m] = (Hit) { .kind = COMPONENT_NONE, .index = (usize) -1, .point = { NAN, NAN }, .distance = FLT_MAX };
+    }
+    if (bvh->primitives.length == 0 || count == 0) return;
+
+    Vector2 axis = Vector2_Normalize(&rays[0]->direction);
+    Vector2 normal = { -axis.y, axis.x };
+    Vector2 inverses[TRACE_PACKET_SIZE];
+    f32 lengths[TRACE_PACKET_SIZE];
+    f32 alongs[TRACE_PACKET_SIZE];
+    f32 across_min = FLT_MAX, across_max = -FLT_MAX, along_min = FLT_MAX;
+    // sine of the widest angle between a ray and the axis
+    f32 spread = 0;
+    for (u32 m = 0; m < count; m++) {
+        Ray *ray = rays[m];
+        inverses[m] = (Vector2) { 1.0 / ray->direction.x, 1.0 / ray->direction.y };
+        lengths[m] = Vector2_Length(&ray->direction);
+        alongs[m] = Vector2_Dot(&ray->start, &axis);
+        f32 across = Vector2_Dot(&ray->start, &normal);
+        across_min = fminf(across_min, across);
+        across_max = fmaxf(across_max, across);
+        along_min = fminf(along_min, alongs[m]);
+        spread = fmaxf(spread, fabsf(Vector2_Dot(&ray->direction, &normal)) / lengths[m]);
+    }
+
+    // the culling below assumes every ray moves along the axis at least half
+    // as fast as it moves overall
+    if (!(spread <= 0.5f)) {
+        for (u32 m = 0; m < count; m++) Bvh_Closest(bvh, rays[m], hits + m);
+        return;
+    }
+
+    SegmentsKernel kernel = Segments_Kernel();
+    // farthest along the axis any ray can still find a closer hit
+    f32 reach = FLT_MAX;
+
+    u32 stack[64];
+    u32 top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        u32 node_index = stack[--top];
+        BvhNode *node = bvh->nodes.data + node_index;
+        f32 along_low, along_high, across_low, across_high;
+        BvhNode_Project(node, &axis, &along_low, &along_high);
+        if (along_high < along_min || along_low > reach) continue;
+        f32 margin = BVH_PACKET_MARGIN + 2 * spread * (along_high - along_min);
+        BvhNode_Project(node, &normal, &across_low, &across_high);
+        if (across_high < across_min - margin || across_low > across_max + margin) continue;
+
+        if (node->count > 0) {
+            bool closer = false;
+            for (u32 m = 0; m < count; m++) {
+                Ray *ray = rays[m];
+                if (BvhNode_Distance(node, &ray->start, inverses + m) >= hits[m].distance) continue;
+                hits[m].tests += node->count;
+                usize i = kernel(&bvh->segments, node->first, node->count, &ray->start, &ray->direction, &hits[m].distance);
+                if (i != (usize) -1) {
+                    hits[m].kind = bvh->primitives.data[i].kind;
+                    hits[m].index = bvh->primitives.data[i].index;
+                    closer = true;
+                }
+            }
+            if (!closer) continue;
+            reach = -FLT_MAX;
+            for (u32 m = 0; m < count; m++) reach = fmaxf(reach, alongs[m] + hits[m].distance * lengths[m]);
+            continue;
+        }
+
+        // visit the child nearer along the axis first
+        BvhNode *left = bvh->nodes.data + node->first;
+        f32 left_center = (left->min.x + left->max.x) * axis.x + (left->min.y + left->max.y) * axis.y;
+        f32 right_center = (left[1].min.x + left[1].max.x) * axis.x + (left[1].min.y + left[1].max.y) * axis.y;
+        if (left_center < right_center) {
+            stack[top++] = node->first + 1;
+            stack[top++] = node->first;
+        } else {
+            stack[top++] = node->first;
+            stack[top++] = node->first + 1;
+        }
+    }
+
+    for (u32 m = 0; m < count; m++) {
+        if (hits[m].kind == COMPONENT_NONE) continue;
+        hits[m].point = (Vector2) {
+            rays[m]->start.x + rays[m]->direction.x * hits[m].distance,
+            rays[m]->start.y + rays[m]->direction.y * hits[m].distance
+        };
+    }
+}
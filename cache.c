@@ -0,0 +1,197 @@
+#pragma once
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/threads.c"
+#include "lines.c"
+#include "components.c"
+#include "lights.c"
+#include "trace.c"
+
+// Keeps every ray's traced path between frames and only retraces rays marked
+// dirty. Rays are dirty when they are new, when the scene logged a change to
+// them (their source moved or was added or removed), or when a component was
+// added, moved or removed across their cached path.
+
+typedef struct {
+    LightLines path;
+    TraceEnd end;
+    Vector2 min;
+    Vector2 max;
+    bool dirty;
+} RayPath;
+
+typedef struct {
+    RayPath *data;
+    usize length;
+    usize capacity;
+} RayPaths;
+
+typedef struct {
+    RayPaths paths;
+    Arena arena;
+    // work done by the last update
+    TraceStats stats;
+
+    // scratch list of dirty ray indices handed to the workers
+    RayIndices dirty;
+    Tracer *tracer;
+    Scene *scene;
+} TraceCache;
+
+void TraceCache_Free(TraceCache *cache) {
+    Arena_Free(&cache->arena);
+    *cache = (TraceCache) { 0 };
+}
+
+void TraceCache_MarkRay(TraceCache *cache, usize index) {
+    if (index < cache->paths.length) cache->paths.data[index].dirty = true;
+}
+
+// Marks every ray whose cached path passes through the bounding box of `line`.
+// The box is padded by a pixel: a path that ends on an axis-aligned component
+// can land just outside its zero-width box through rounding.
+void TraceCache_MarkRegion(TraceCache *cache, Line *line) {
+    Vector2 min = { fminf(line->start.x, line->end.x) - 1, fminf(line->start.y, line->end.y) - 1 };
+    Vector2 max = { fmaxf(line->start.x, line->end.x) + 1, fmaxf(line->start.y, line->end.y) + 1 };
+
+    for (usize i = 0; i < cache->paths.length; i++) {
+        RayPath *path = cache->paths.data + i;
+        if (path->dirty) continue;
+        if (path->max.x < min.x || path->min.x > max.x || path->max.y < min.y || path->min.y > max.y) continue;
+
+        for (usize j = 0; j < path->path.length; j++) {
+            if (Line_IntersectsBox(&path->path.data[j].line, &min, &max)) {
+                path->dirty = true;
+                break;
+            }
+        }
+    }
+}
+
+static void RayPath_Fit(RayPath *path) {
+    path->min = (Vector2) { FLT_MAX, FLT_MAX };
+    path->max = (Vector2) { -FLT_MAX, -FLT_MAX };
+    for (usize i = 0; i < path->path.length; i++) {
+        Line *line = &path->path.data[i].line;
+        path->min.x = fminf(path->min.x, fminf(line->start.x, line->end.x));
+        path->min.y = fminf(path->min.y, fminf(line->start.y, line->end.y));
+        path->max.x = fmaxf(path->max.x, fmaxf(line->start.x, line->end.x));
+        path->max.y = fmaxf(path->max.y, fmaxf(line->start.y, line->end.y));
+    }
+}
+
+static void TraceCache_TraceChunk(void *context, usize chunk, usize worker) {
+    TraceCache *cache = context;
+    Scene *scene = cache->scene;
+
+    usize first = chunk * TRACE_CHUNK_SIZE;
+    usize last = first + TRACE_CHUNK_SIZE < cache->dirty.length ? first + TRACE_CHUNK_SIZE : cache->dirty.length;
+    Tracer *tracer = cache->tracer;
+    TraceStats *stats = tracer->stats + worker;
+    Arena *arena = tracer->arenas + worker;
+    for (usize i = first; i < last;) {
+        Ray *rays[TRACE_PACKET_SIZE] = { Rays_Get(&scene->light_rays, cache->dirty.data[i]) };
+        u32 count = 1;
+        while (tracer->packets && count < TRACE_PACKET_SIZE && i + count < last) {
+            Ray *ray = Rays_Get(&scene->light_rays, cache->dirty.data[i + count]);
+            if (!trace_coherent(rays[0], ray)) break;
+            rays[count++] = ray;
+        }
+
+        if (count == 1) {
+            RayPath *path = cache->paths.data + cache->dirty.data[i++];
+            path->path.length = 0;
+            path->end = trace_ray(scene, rays[0], &path->path, stats, arena);
+            RayPath_Fit(path);
+            path->dirty = false;
+            continue;
+        }
+
+        // the packet's segments come out together, and are then copied into
+        // each ray's path
+        TracePacketScratch *scratch = tracer->scratches + worker;
+        u32 counts[TRACE_PACKET_SIZE];
+        TraceEnd ends[TRACE_PACKET_SIZE];
+        scratch->paths.length = 0;
+        trace_packet(scene, rays, count, counts, ends, &scratch->paths, scratch, stats, arena);
+
+        LightLine *segments = scratch->paths.data;
+        for (u32 m = 0; m < count; m++) {
+            RayPath *path = cache->paths.data + cache->dirty.data[i++];
+            path->path.length = 0;
+            List_Reserve(&path->path, counts[m], arena);
+            memcpy(path->path.data, segments, counts[m] * sizeof(LightLine));
+            path->path.length = counts[m];
+            path->end = ends[m];
+            RayPath_Fit(path);
+            path->dirty = false;
+            segments += counts[m];
+        }
+    }
+}
+
+// Picks up the changes logged by the scene, retraces dirty rays on the
+// tracer's workers and rebuilds `light_lines` in `arena` from the cached
+// paths. Returns how many rays were retraced.
+usize TraceCache_Update(TraceCache *cache, Tracer *tracer, Scene *scene, LightLines *light_lines, Arena *arena) {
+    Scene_UpdateAccelerator(scene);
+
+    // new rays have never been traced
+    while (cache->paths.length < scene->light_rays.length) {
+        *List_Push(&cache->paths, &cache->arena) = (RayPath) { .dirty = true };
+    }
+
+    for (usize i = 0; i < scene->changed_rays.length; i++) {
+        TraceCache_MarkRay(cache, scene->changed_rays.data[i]);
+    }
+    for (usize i = 0; i < scene->changed_regions.length; i++) {
+        TraceCache_MarkRegion(cache, scene->changed_regions.data + i);
+    }
+    scene->changed_rays.length = 0;
+    scene->changed_regions.length = 0;
+
+    cache->dirty.length = 0;
+    for (usize i = 0; i < cache->paths.length; i++) {
+        if (cache->paths.data[i].dirty) *List_Push(&cache->dirty, &cache->arena) = i;
+    }
+
+    usize retraced = cache->dirty.length;
+    cache->stats = (TraceStats) { 0 };
+    if (retraced > 0) {
+        cache->tracer = tracer;
+        cache->scene = scene;
+        for (usize i = 0; i < tracer->pool.count; i++) tracer->stats[i] = (TraceStats) { 0 };
+        usize chunks = (retraced + TRACE_CHUNK_SIZE - 1) / TRACE_CHUNK_SIZE;
+        ThreadPool_Run(&tracer->pool, chunks, TraceCache_TraceChunk, cache);
+        for (usize i = 0; i < tracer->pool.count; i++) TraceStats_Merge(&cache->stats, tracer->stats + i);
+    }
+
+    usize total = 0;
+    for (usize i = 0; i < cache->paths.length; i++) total += cache->paths.data[i].path.length;
+    light_lines->length = 0;
+    List_Reserve(light_lines, total, arena);
+    for (usize i = 0; i < cache->paths.length; i++) {
+        LightLines *path = &cache->paths.data[i].path;
+        memcpy(light_lines->data + light_lines->length, path->data, path->length * sizeof(LightLine));
+        light_lines->length += path->length;
+    }
+
+    return retraced;
+}
+
+// Totals over every cached path, i.e. over what is currently on screen.
+TraceStats TraceCache_Stats(TraceCache *cache) {
+    TraceStats stats = { 0 };
+    for (usize i = 0; i < cache->paths.length; i++) {
+        RayPath *path = cache->paths.data + i;
+        TraceStats_Add(&stats, path->end, path->path.length);
+    }
+    return stats;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "constants.c"
+#include "lines.c"
+#include "optics.c"
+
+// Every optical component lives in one table, tagged by kind, so the tracer
+// finds the closest hit in a single pass and picks the response by kind.
+
+typedef enum {
+    COMPONENT_NONE,
+    COMPONENT_MIRROR,
+    COMPONENT_LENS
+} ComponentKind;
+
+// `line` is the component's surface and `normal` and `center` are cached from
+// it by Component_Update. `throughput` is the fraction of intensity that leaves
+// the component: reflectivity for mirrors, transmission for lenses. The
+// remaining fields only mean something for the kinds that use them; a lens
+// with nonzero `dispersion` splits white rays (see dispersed_focal_length).
+typedef struct {
+    ComponentKind kind;
+    Line line;
+    Vector2 normal;
+    Vector2 center;
+    f32 throughput;
+    f32 focal_length;
+    f32 dispersion;
+} Component;
+
+typedef struct {
+    Component *data;
+    usize length;
+    usize capacity;
+} Components;
+
+// `tests` counts the ray/segment tests it took to find the hit.
+typedef struct {
+    ComponentKind kind;
+    usize index;
+    Vector2 point;
+    f32 distance;
+    u32 tests;
+} Hit;
+
+Component *Components_Get(Components *components, usize index) {
+    if (index < 0 || index >= components->length) { raise(SIGTRAP); }
+    return components->data + index;
+}
+
+// Recomputes the cached geometry; call after changing `line`.
+void Component_Update(Component *component) {
+    component->normal = Line_Normal(&component->line);
+    component->center = Vector2_Average(&component->line.start, &component->line.end);
+}
+
+void Components_AddMirror(Components *components, Line *line, Arena *arena) {
+    Component *component = List_Push(components, arena);
+    *component = (Component) {
+        .kind = COMPONENT_MIRROR,
+        .line = *line,
+        .throughput = MIRROR_REFLECTIVITY
+    };
+    Component_Update(component);
+}
+
+void Components_AddLens(Components *components, Line *line, f32 focal_length, Arena *arena) {
+    Component *component = List_Push(components, arena);
+    *component = (Component) {
+        .kind = COMPONENT_LENS,
+        .line = *line,
+        .throughput = LENS_TRANSMISSION,
+        .focal_length = focal_length
+    };
+    Component_Update(component);
+}
+
+// Direction of the ray leaving `component` after hitting it at `intersection`.
+Vector2 Component_Respond(Component *component, Ray *light_ray, Vector2 *intersection) {
+    switch (component->kind) {
+        case COMPONENT_MIRROR:
+            return reflect_mirror(light_ray, &component->normal);
+        case COMPONENT_LENS:
+            return refract_lens(light_ray, &component->normal, &component->center, intersection,
+                dispersed_focal_length(component->focal_length, component->dispersion, light_ray->wavelength));
+        default:
+            raise(SIGTRAP);
+            return light_ray->direction;
+    }
+}
+
+// Brute-force closest hit over every component, comparing distances along the
+// ray directly.
+bool closest_component(Ray *ray, Components *components, Hit *hit) {
+    *hit = (Hit) { .kind = COMPONENT_NONE, .index = (usize) -1, .point = { NAN, NAN }, .distance = FLT_MAX, .tests = components->length };
+
+    Vector2 direction = Ray_ToVector(ray);
+    for (usize i = 0; i < components->length; i++) {
+        f32 distance = ray_line_distance(&ray->start, &direction, &components->data[i].line);
+        if (distance < hit->distance) {
+            hit->distance = distance;
+            hit->index = i;
+        }
+    }
+
+    if (hit->index == (usize) -1) return false;
+    hit->kind = components->data[hit->index].kind;
+    hit->point = (Vector2) {
+        ray->start.x + direction.x * hit->distance,
+        ray->start.y + direction.y * hit->distance
+    };
+    return true;
+}
@@ -15,3 +15,118 @@ const u32 LIGHT_RAY_LENGTH = 4096;
 const u32 POINT_SOURCE_RAY_NUMBER = 32;
 const u32 LINE_SOURCE_RAY_DISTANCE = 32;
 
+const u32 MAX_BOUNCES = 256;
+const f32 MIN_INTENSITY = 1e-3;
+const f32 MIRROR_REFLECTIVITY = 0.95;
+const f32 LENS_TRANSMISSION = 0.98;
+
+// nanometers; the Fraunhofer d, F and C lines define a glass's dispersion
+const f32 WAVELENGTH_D = 587.6;
+const f32 WAVELENGTH_F = 486.1;
+const f32 WAVELENGTH_C = 656.3;
+const f32 SPECTRUM_MIN = 380;
+const f32 SPECTRUM_MAX = 700;
+// wavelengths a white ray splits into; even, and sizes arrays
+enum { SPECTRUM_SAMPLES = 8 };
+// inverse Abbe number of a dense flint glass
+const f32 LENS_DISPERSION = 0.05;
+
+const f32 PICK_RADIUS = 8;
+const f32 LENS_FOCAL_LENGTH = 300;
+const f32 FOCAL_LENGTH_STEP = 1.1;
+
+const u32 BVH_LEAF_SIZE = 8;
+const u32 BVH_MAX_DEPTH = 48;
+// pixels; keeps packet culling conservative against rounding
+const f32 BVH_PACKET_MARGIN = 1;
+const f32 GRID_SEGMENTS_PER_CELL = 2;
+const f32 GRID_CELLS_PER_SEGMENT = 4;
+const f32 GRID_MAX_CELLS = 1 << 20;
+const f32 GRID_MARGIN = 1e-2;
+// radians between lens normals still treated as one axis, and pixels of
+// clearance kept from lens edges and between lenses
+const f32 PARAXIAL_MAX_TILT = 1e-3;
+const f32 PARAXIAL_MARGIN = 1;
+const u32 PARAXIAL_NONE = UINT32_MAX;
+const u32 TRACE_CHUNK_SIZE = 64;
+const u32 TRACE_NO_COMPONENT = UINT32_MAX;
+const usize TRACE_ARENA_CAPACITY = 16 * 1024 * 1024;
+// most rays traced as one packet; sizes arrays
+enum { TRACE_PACKET_SIZE = 16 };
+// how far apart two unit directions can be and still share a packet
+const f32 TRACE_PACKET_SPREAD = 1e-3;
+
+const usize RENDER_BATCH_MIN_SEGMENTS = 8192;
+const usize RENDER_BATCH_MAX_SEGMENTS = 512 * 1024;
+
+const u32 IRRADIANCE_TILE_SIZE = 64;
+const u32 IRRADIANCE_CHUNK_SIZE = 4096;
+const usize IRRADIANCE_ARENA_CAPACITY = 32 * 1024 * 1024;
+const f32 IRRADIANCE_EXPOSURE = 1.0;
+
+const usize PROGRESSIVE_RAY_BUDGET = 4096;
+const usize PROGRESSIVE_ARENA_CAPACITY = 64 * 1024 * 1024;
+
+// Rays are added between neighbors that hit different components, land more
+// than REFINE_MAX_GAP pixels apart or leave more than REFINE_MAX_TURN radians
+// apart. The turn is just over the spacing of a point source's rays, so an
+// undisturbed fan is left be.
+const usize REFINE_RAY_BUDGET = 4096;
+const u32 REFINE_MAX_DEPTH = 8;
+const f32 REFINE_MAX_GAP = 16;
+const f32 REFINE_MAX_TURN = 0.25;
+const u32 REFINE_ADDED = UINT32_MAX;
+const usize REFINE_ARENA_CAPACITY = 16 * 1024 * 1024;
+
+// Crossings are found in cells of FOCUS_CELL_SIZE pixels, between segments at
+// least FOCUS_MIN_SINE apart in direction. A focal point needs a cell with
+// FOCUS_MIN_CELL_CROSSINGS crossings and FOCUS_MIN_RAYS rays crossing.
+const u32 FOCUS_CELL_SIZE = 32;
+const f32 FOCUS_MARGIN = 1e-2;
+const f32 FOCUS_MIN_SINE = 1e-2;
+const u32 FOCUS_MIN_CELL_CROSSINGS = 4;
+const u32 FOCUS_MIN_RAYS = 3;
+const usize FOCUS_ARENA_CAPACITY = 16 * 1024 * 1024;
+// the overlay circles focal points at least this big, and labels the brightest
+const f32 FOCUS_MARK_RADIUS = 4;
+const usize FOCUS_LABELS = 8;
+
+// A sweep scores a variant by the spread of the rays crossing its target, and
+// ranks variants with fewer than SWEEP_MIN_HITS crossings last. Sweeps of more
+// than SWEEP_MAX_VARIANTS variants are refused.
+const u32 SWEEP_MIN_HITS = 2;
+const usize SWEEP_MAX_VARIANTS = 1 << 24;
+const usize SWEEP_TOP = 20;
+const usize SWEEP_ARENA_CAPACITY = 1024 * 1024;
+
+const u32 SCENE_FILE_VERSION = 2;
+const u64 SCENE_FILE_ALIGN = 64;
+char *const SCENE_SAVE_PATH = "saved.scene";
+
+const u32 TRACE_FILE_VERSION = 2;
+const usize TRACE_EXPORT_MAX_RECORDS = 4 * 1024 * 1024;
+char *const TRACE_EXPORT_PATH = "trace.bin";
+
+// sizes the profiler's ring buffer, so it has to be a constant expression
+enum { PROFILE_FRAMES = 240 };
+const f32 PROFILE_OVERLAY_X = 480;
+char *const PROFILE_DUMP_PATH = "profile.csv";
+
+const f32 GOLDEN_TOLERANCE = 1e-2;
+const usize GOLDEN_SCENE_SIZE = 64;
+const usize GOLDEN_SCENE_RAYS = 64;
+const usize GOLDEN_REFINE_BUDGET = 256;
+const u32 GOLDEN_SWEEP_STEPS = 5;
+char *const GOLDEN_SCENE_PATH = "build/golden.scene";
+
+// BENCH_INPUTS must be a power of two
+const usize BENCH_INPUTS = 1024;
+const usize BENCH_TARGETS = 64;
+const usize BENCH_RAYS = 1024;
+const usize BENCH_MIN_SIZE = 16;
+const usize BENCH_MAX_SIZE = 65536;
+const usize BENCH_BRUTE_MAX_SIZE = 1024;
+const usize BENCH_THREADS_SIZE = 16384;
+const f64 BENCH_MIN_TIME = 0.2;
+const usize BENCH_FOCUS_MAX_RAYS = 65536;
+const u32 BENCH_SWEEP_VARIANTS = 1024;
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "constants.c"
+#include "lines.c"
+#include "trace.c"
+
+// Streams traced segments to a file for offline analysis. The frame loop adds
+// each ray's segments to the front buffer, and a writer thread writes the back
+// buffer to disk. The buffers are swapped at the end of a frame if the writer
+// is idle. Otherwise the frame stays in the front buffer until the next swap,
+// so tracing only ever waits for the disk if the front buffer passes
+// TRACE_EXPORT_MAX_RECORDS.
+//
+// The file is a TraceFileHeader followed by chunks, one per exported frame:
+// a TraceChunkHeader and then `count` TraceRecords. Like scene files, it is
+// native-endian.
+
+typedef struct {
+    char magic[4];
+    u32 version;
+    u32 record_size;
+    u32 reserved;
+} TraceFileHeader;
+
+typedef struct {
+    u32 frame;
+    u32 count;
+} TraceChunkHeader;
+
+// One segment of ray `ray`, after `bounce` interactions. `component` and
+// `wavelength` are as in LightLine.
+typedef struct {
+    u32 ray;
+    u32 bounce;
+    u32 component;
+    f32 intensity;
+    Line line;
+    f32 wavelength;
+} TraceRecord;
+
+typedef struct {
+    TraceRecord *data;
+    usize length;
+    usize capacity;
+} TraceRecords;
+
+typedef struct {
+    TraceChunkHeader *data;
+    usize length;
+    usize capacity;
+} TraceChunks;
+
+typedef struct {
+    TraceRecords records;
+    TraceChunks chunks;
+    Arena arena;
+} TraceBuffer;
+
+typedef struct {
+    FILE *file;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+    pthread_cond_t done;
+
+    TraceBuffer buffers[2];
+    // the main thread only touches `front`, the writer only `back`
+    TraceBuffer *front;
+    TraceBuffer *back;
+    // whether the writer holds `back`
+    bool writing;
+    bool quit;
+    bool failed;
+
+    u32 frame;
+    // records in `front` not yet closed into a chunk
+    usize open;
+    usize stalls;
+} TraceExport;
+
+static void TraceBuffer_Write(TraceBuffer *buffer, FILE *file, bool *failed) {
+    TraceRecord *records = buffer->records.data;
+    for (usize i = 0; i < buffer->chunks.length && !*failed; i++) {
+        TraceChunkHeader *chunk = buffer->chunks.data + i;
+        *failed = fwrite(chunk, sizeof(*chunk), 1, file) != 1
+            || fwrite(records, sizeof(TraceRecord), chunk->count, file) != chunk->count;
+        records += chunk->count;
+    }
+
+    // keeps the memory for the next frames, coalesced into one block
+    Arena_Reset(&buffer->arena);
+    buffer->records = (TraceRecords) { 0 };
+    buffer->chunks = (TraceChunks) { 0 };
+}
+
+static void *TraceExport_Work(void *argument) {
+    TraceExport *export = argument;
+
+    pthread_mutex_lock(&export->mutex);
+    for (;;) {
+        while (!export->writing && !export->quit) pthread_cond_wait(&export->ready, &export->mutex);
+        // write what was handed over before quitting
+        if (!export->writing) break;
+        pthread_mutex_unlock(&export->mutex);
+
+        bool failed = export->failed;
+        TraceBuffer_Write(export->back, export->file, &failed);
+
+        pthread_mutex_lock(&export->mutex);
+        export->failed = failed;
+        export->writing = false;
+        pthread_cond_signal(&export->done);
+    }
+    pthread_mutex_unlock(&export->mutex);
+    return NULL;
+}
+
+// Creates the file at `path` and starts the writer. Returns false if the file
+// can't be written or the writer can't be started.
+bool TraceExport_Open(TraceExport *export, char *path) {
+    *export = (TraceExport) { 0 };
+    export->file = fopen(path, "wb");
+    if (!export->file) return false;
+
+    TraceFileHeader header = { .version = TRACE_FILE_VERSION, .record_size = sizeof(TraceRecord) };
+    memcpy(header.magic, "SLTR", sizeof(header.magic));
+    if (fwrite(&header, sizeof(header), 1, export->file) != 1) {
+        fclose(export->file);
+        return false;
+    }
+
+    export->front = export->buffers;
+    export->back = export->buffers + 1;
+    pthread_mutex_init(&export->mutex, NULL);
+    pthread_cond_init(&export->ready, NULL);
+    pthread_cond_init(&export->done, NULL);
+    if (pthread_create(&export->thread, NULL, TraceExport_Work, export) != 0) {
+        fclose(export->file);
+        pthread_mutex_destroy(&export->mutex);
+        pthread_cond_destroy(&export->ready);
+        pthread_cond_destroy(&export->done);
+        return false;
+    }
+    return true;
+}
+
+// Adds the segments of ray `ray` to the current frame, in path order.
+void TraceExport_AddRay(TraceExport *export, u32 ray, LightLine *light_lines, usize count) {
+    TraceBuffer *front = export->front;
+    List_Reserve(&front->records, front->records.length + count, &front->arena);
+    // after a white ray splits, each wavelength's run of segments starts from
+    // the bounce the split happened at
+    u32 white = 0;
+    u32 bounce = 0;
+    for (usize i = 0; i < count; i++) {
+        f32 wavelength = light_lines[i].wavelength;
+        if (wavelength == 0) white++;
+        else if (i > 0 && light_lines[i - 1].wavelength != wavelength) bounce = white;
+        front->records.data[front->records.length++] = (TraceRecord) {
+            .ray = ray,
+            .bounce = bounce++,
+            .component = light_lines[i].component,
+            .intensity = light_lines[i].intensity,
+            .line = light_lines[i].line,
+            .wavelength = wavelength
+        };
+    }
+    export->open += count;
+}
+
+// Waits for the writer to finish and hands it the front buffer.
+static void TraceExport_Swap(TraceExport *export) {
+    while (export->writing) pthread_cond_wait(&export->done, &export->mutex);
+    TraceBuffer *swap = export->front;
+    export->front = export->back;
+    export->back = swap;
+    export->writing = true;
+    pthread_cond_signal(&export->ready);
+}
+
+// Closes the current frame into a chunk and passes the buffered frames to the
+// writer if it is idle or the buffer is full.
+void TraceExport_EndFrame(TraceExport *export) {
+    TraceBuffer *front = export->front;
+    if (export->open > 0) {
+        *List_Push(&front->chunks, &front->arena) = (TraceChunkHeader) { .frame = export->frame, .count = export->open };
+        export->open = 0;
+    }
+    export->frame++;
+    if (front->chunks.length == 0) return;
+
+    pthread_mutex_lock(&export->mutex);
+    bool full = front->records.length >= TRACE_EXPORT_MAX_RECORDS;
+    if (!export->writing || full) {
+        if (export->writing) export->stalls++;
+        TraceExport_Swap(export);
+    }
+    pthread_mutex_unlock(&export->mutex);
+}
+
+// Writes out everything still buffered and closes the file. Returns false if
+// any write failed.
+bool TraceExport_Close(TraceExport *export) {
+    TraceExport_EndFrame(export);
+
+    pthread_mutex_lock(&export->mutex);
+    if (export->front->chunks.length > 0) TraceExport_Swap(export);
+    export->quit = true;
+    pthread_cond_signal(&export->ready);
+    pthread_mutex_unlock(&export->mutex);
+    pthread_join(export->thread, NULL);
+
+    bool failed = export->failed;
+    failed |= fclose(export->file) != 0;
+    for (usize i = 0; i < 2; i++) Arena_Free(&export->buffers[i].arena);
+    pthread_mutex_destroy(&export->mutex);
+    pthread_cond_destroy(&export->ready);
+    pthread_cond_destroy(&export->done);
+    return !failed;
+}
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/threads.c"
+#include "lib/vectors.c"
+#include "constants.c"
+#include "lines.c"
+#include "scene.c"
+#include "trace.c"
+#include "cache.c"
+#include "binning.c"
+
+// Finds where traced rays converge, i.e. focal points and caustics. Testing
+// every pair of segments for a crossing is quadratic, so the segments are
+// first binned into a spatial hash of FOCUS_CELL_SIZE cells over the screen,
+// and pairs are only tested within a cell, each pair in the cell that holds
+// its crossing. Within a cell a segment is tested against the segments 1, 2,
+// 4, 8... places after it, so a cell that every ray passes through costs
+// O(n log n) and still pairs rays far enough apart to cross at a clear angle.
+// Pairs crossing at under FOCUS_MIN_SINE are dropped, as their crossing is
+// mostly rounding.
+//
+// Only rays of the same bundle (the rays of one source) that leave the same
+// component with the same wavelength are paired: rays of different sources
+// cross all over, segments straight from a source never converge, and colors
+// focus apart.
+//
+// Cells with at least FOCUS_MIN_CELL_CROSSINGS crossings are grown into
+// clusters with their neighbors, and each cluster of crossings from at least
+// FOCUS_MIN_RAYS rays is a focal point: its intensity-weighted center, its
+// RMS spot size and the rays that cross there.
+//
+// The cells are tested in parallel, each worker keeping its crossings in its
+// own list and arena.
+
+typedef struct {
+    Line line;
+    Vector2 direction;
+    f32 intensity;
+    f32 wavelength;
+    u32 ray;
+    u32 bundle;
+    // the slot of the component the segment leaves
+    u32 from;
+} FocusSegment;
+
+typedef struct {
+    FocusSegment *data;
+    usize length;
+    usize capacity;
+} FocusSegments;
+
+typedef struct {
+    u32 *data;
+    usize length;
+    usize capacity;
+} FocusIndices;
+
+// Where two segments cross, weighted by the dimmer of them.
+typedef struct {
+    Vector2 point;
+    f32 weight;
+    u32 rays[2];
+} FocusCrossing;
+
+typedef struct {
+    FocusCrossing *data;
+    usize length;
+    usize capacity;
+} FocusCrossings;
+
+// Where the crossings of one cell went.
+typedef struct {
+    u32 worker;
+    u32 first;
+    u32 count;
+} FocusSpan;
+
+// `spot` is the RMS distance of the crossings from `point`, and the rays that
+// cross there are `rays[first_ray .. first_ray + ray_count)` of the Focus.
+typedef struct {
+    Vector2 point;
+    f32 spot;
+    f32 intensity;
+    u32 crossings;
+    u32 first_ray;
+    u32 ray_count;
+} FocalPoint;
+
+typedef struct {
+    FocalPoint *data;
+    usize length;
+    usize capacity;
+} FocalPoints;
+
+typedef struct {
+    ThreadPool *pool;
+    // the segments, cells and results of the last run
+    Arena arena;
+    Arena *arenas;
+    FocusCrossings *crossings;
+
+    u32 columns;
+    u32 rows;
+    FocusSegments segments;
+    u32 ray_count;
+    // cell c holds the segments in binned[cells[c] .. cells[c + 1])
+    FocusIndices cells;
+    FocusIndices binned;
+    FocusSpan *spans;
+
+    FocalPoints points;
+    FocusIndices rays;
+    usize crossing_count;
+} Focus;
+
+void Focus_Init(Focus *focus, ThreadPool *pool, Arena *arena) {
+    *focus = (Focus) {
+        .pool = pool,
+        .arena = Arena_New(FOCUS_ARENA_CAPACITY),
+        .columns = (WIDTH + FOCUS_CELL_SIZE - 1) / FOCUS_CELL_SIZE,
+        .rows = (HEIGHT + FOCUS_CELL_SIZE - 1) / FOCUS_CELL_SIZE
+    };
+    focus->arenas = Arena_Alloc(arena, Arena, pool->count);
+    focus->crossings = Arena_Alloc(arena, FocusCrossings, pool->count);
+}
+
+void Focus_Free(Focus *focus) {
+    Arena_Free(&focus->arena);
+    for (usize i = 0; i < focus->pool->count; i++) Arena_Free(focus->arenas + i);
+}
+
+// Forgets the last run, ready for new paths.
+void Focus_Begin(Focus *focus) {
+    Arena_Reset(&focus->arena);
+    focus->segments = (FocusSegments) { 0 };
+    focus->cells = (FocusIndices) { 0 };
+    focus->binned = (FocusIndices) { 0 };
+    focus->points = (FocalPoints) { 0 };
+    focus->rays = (FocusIndices) { 0 };
+    focus->ray_count = 0;
+    focus->crossing_count = 0;
+}
+
+// Adds the segments of ray `ray` that leave a component, given in path order
+// as trace_ray gives them.
+void Focus_AddPath(Focus *focus, u32 ray, u32 bundle, LightLine *path, usize count) {
+    // after a white ray splits, each color's run of segments leaves the lens
+    // the white ray last reached
+    u32 from = TRACE_NO_COMPONENT;
+    u32 split = TRACE_NO_COMPONENT;
+    for (usize i = 0; i < count; i++) {
+        LightLine *light_line = path + i;
+        if (i > 0 && light_line->wavelength != path[i - 1].wavelength) from = split;
+        if (from != TRACE_NO_COMPONENT) {
+            Vector2 delta = Vector2_Subtract(&light_line->line.end, &light_line->line.start);
+            *List_Push(&focus->segments, &focus->arena) = (FocusSegment) {
+                .line = light_line->line,
+                .direction = Vector2_Normalize(&delta),
+                .intensity = light_line->intensity,
+                .wavelength = light_line->wavelength,
+                .ray = ray,
+                .bundle = bundle,
+                .from = from
+            };
+        }
+        if (light_line->wavelength == 0) split = light_line->component;
+        from = light_line->component;
+    }
+    if (ray >= focus->ray_count) focus->ray_count = ray + 1;
+}
+
+// Adds every cached path. The rays of each source are a bundle, and the bare
+// rays are one more.
+void Focus_AddCache(Focus *focus, Scene *scene, TraceCache *cache) {
+    u32 *bundles = Arena_Alloc(&focus->arena, u32, cache->paths.length);
+    u32 bundle = 1;
+    for (usize i = 0; i < scene->point_lights.length; i++, bundle++) {
+        usize *ray_indices = scene->point_lights.data[i].ray_indices;
+        for (usize k = 0; k < POINT_SOURCE_RAY_NUMBER; k++) bundles[ray_indices[k]] = bundle;
+    }
+    for (usize i = 0; i < scene->line_lights.length; i++, bundle++) {
+        LineLight *line_light = scene->line_lights.data + i;
+        for (u32 k = 0; k < line_light->ray_count; k++) bundles[line_light->ray_indices[k]] = bundle;
+    }
+
+    for (usize i = 0; i < cache->paths.length; i++) {
+        LightLines *path = &cache->paths.data[i].path;
+        Focus_AddPath(focus, i, bundles[i], path->data, path->length);
+    }
+}
+
+// What Focus_Run bins, for the binning callbacks: the segments clipped to the
+// screen, or NULL where they miss it.
+typedef struct {
+    Focus *focus;
+    Line **lines;
+} FocusBuild;
+
+static Line *Focus_Line(void *context, usize item) {
+    return ((FocusBuild *) context)->lines[item];
+}
+
+static void Focus_Place(void *context, usize item, u32 slot) {
+    ((FocusBuild *) context)->focus->binned.data[slot] = item;
+}
+
+static void Focus_TestCell(void *context, usize cell, usize worker) {
+    Focus *focus = context;
+    FocusCrossings *crossings = focus->crossings + worker;
+    Arena *arena = focus->arenas + worker;
+    u32 column = cell % focus->columns;
+    u32 row = cell / focus->columns;
+    u32 *binned = focus->binned.data + focus->cells.data[cell];
+    u32 count = focus->cells.data[cell + 1] - focus->cells.data[cell];
+
+    usize first = crossings->length;
+    for (u32 i = 0; i < count; i++) {
+        FocusSegment *a = focus->segments.data + binned[i];
+        for (u32 step = 1; step < count - i; step *= 2) {
+            FocusSegment *b = focus->segments.data + binned[i + step];
+            if (a->ray == b->ray || a->bundle != b->bundle || a->from != b->from || a->wavelength != b->wavelength) continue;
+            if (fabsf(Vector2_Cross(&a->direction, &b->direction)) < FOCUS_MIN_SINE) continue;
+
+            Vector2 point = lines_intersect(&a->line, &b->line);
+            if (isnan(point.x) || point.x < 0 || point.y < 0) continue;
+            if ((u32) (point.x / FOCUS_CELL_SIZE) != column || (u32) (point.y / FOCUS_CELL_SIZE) != row) continue;
+            *List_Push(crossings, arena) = (FocusCrossing) {
+                .point = point,
+                .weight = fminf(a->intensity, b->intensity),
+                .rays = { a->ray, b->ray }
+            };
+        }
+    }
+    focus->spans[cell] = (FocusSpan) { .worker = worker, .first = first, .count = crossings->length - first };
+}
+
+static int FocalPoint_Compare(const void *a, const void *b) {
+    f32 intensity_a = ((FocalPoint *) a)->intensity;
+    f32 intensity_b = ((FocalPoint *) b)->intensity;
+    return (intensity_a < intensity_b) - (intensity_a > intensity_b);
+}
+
+// Grows cluster `label` from the dense cell `seed` through its dense
+// neighbors, taking in the sparse cells around them without growing from
+// those, and adds it to `points` if enough rays cross in it.
+static void Focus_Cluster(Focus *focus, u32 seed, u32 label, u32 *labels, u32 *marks, FocusIndices *stack) {
+    FocusIndices cluster = { 0 };
+    stack->length = 0;
+    *List_Push(stack, &focus->arena) = seed;
+    labels[seed] = label;
+    while (stack->length > 0) {
+        u32 cell = stack->data[--stack->length];
+        *List_Push(&cluster, &focus->arena) = cell;
+        if (focus->spans[cell].count < FOCUS_MIN_CELL_CROSSINGS) continue;
+
+        i32 column = cell % focus->columns;
+        i32 row = cell / focus->columns;
+        for (i32 y = row - 1; y <= row + 1; y++) {
+            for (i32 x = column - 1; x <= column + 1; x++) {
+                if (x < 0 || y < 0 || x >= (i32) focus->columns || y >= (i32) focus->rows) continue;
+                u32 neighbor = y * focus->columns + x;
+                if (labels[neighbor] != 0 || focus->spans[neighbor].count == 0) continue;
+                labels[neighbor] = label;
+                *List_Push(stack, &focus->arena) = neighbor;
+            }
+        }
+    }
+
+    FocalPoint point = { .first_ray = focus->rays.length };
+    Vector2 sum = { 0, 0 };
+    for (usize i = 0; i < cluster.length; i++) {
+        FocusSpan *span = focus->spans + cluster.data[i];
+        FocusCrossing *crossings = focus->crossings[span->worker].data + span->first;
+        for (u32 k = 0; k < span->count; k++) {
+            sum.x += crossings[k].weight * crossings[k].point.x;
+            sum.y += crossings[k].weight * crossings[k].point.y;
+            point.intensity += crossings[k].weight;
+            point.crossings++;
+            for (u32 r = 0; r < 2; r++) {
+                u32 ray = crossings[k].rays[r];
+                if (marks[ray] == label) continue;
+                marks[ray] = label;
+                *List_Push(&focus->rays, &focus->arena) = ray;
+            }
+        }
+    }
+    point.ray_count = focus->rays.length - point.first_ray;
+    if (point.ray_count < FOCUS_MIN_RAYS || !(point.intensity > 0)) {
+        focus->rays.length = point.first_ray;
+        return;
+    }
+    point.point = (Vector2) { sum.x / point.intensity, sum.y / point.intensity };
+
+    f32 spread = 0;
+    for (usize i = 0; i < cluster.length; i++) {
+        FocusSpan *span = focus->spans + cluster.data[i];
+        FocusCrossing *crossings = focus->crossings[span->worker].data + span->first;
+        for (u32 k = 0; k < span->count; k++) {
+            Vector2 offset = Vector2_Subtract(&crossings[k].point, &point.point);
+            spread += crossings[k].weight * Vector2_Dot(&offset, &offset);
+        }
+    }
+    point.spot = sqrtf(spread / point.intensity);
+    *List_Push(&focus->points, &focus->arena) = point;
+}
+
+// Finds the focal points of the paths added since Focus_Begin, brightest
+// first. Returns how many there are.
+usize Focus_Run(Focus *focus) {
+    usize cell_count = (usize) focus->columns * focus->rows;
+    List_Reserve(&focus->cells, cell_count + 1, &focus->arena);
+    focus->cells.length = cell_count + 1;
+    focus->spans = Arena_Alloc(&focus->arena, FocusSpan, cell_count);
+
+    // bin the segments that reach the screen
+    Vector2 bounds_min = { 0, 0 };
+    Vector2 bounds_max = { WIDTH, HEIGHT };
+    Line *clipped = Arena_Alloc(&focus->arena, Line, focus->segments.length);
+    Line **lines = Arena_Alloc(&focus->arena, Line *, focus->segments.length);
+    for (usize i = 0; i < focus->segments.length; i++) {
+        clipped[i] = focus->segments.data[i].line;
+        if (Line_Clip(clipped + i, &bounds_min, &bounds_max)) lines[i] = clipped + i;
+    }
+    Binning binning = { { 0, 0 }, FOCUS_CELL_SIZE, focus->columns, focus->rows, FOCUS_MARGIN };
+    FocusBuild build = { focus, lines };
+    u32 total = Binning_Count(&binning, focus->cells.data, focus->segments.length, Focus_Line, &build);
+    List_Reserve(&focus->binned, total, &focus->arena);
+    focus->binned.length = total;
+    Binning_Place(&binning, focus->cells.data, focus->segments.length, Focus_Line, Focus_Place, &build);
+
+    for (usize i = 0; i < focus->pool->count; i++) {
+        Arena_Reset(focus->arenas + i);
+        focus->crossings[i] = (FocusCrossings) { 0 };
+    }
+    ThreadPool_Run(focus->pool, cell_count, Focus_TestCell, focus);
+    for (usize i = 0; i < focus->pool->count; i++) focus->crossing_count += focus->crossings[i].length;
+
+    u32 *labels = Arena_Alloc(&focus->arena, u32, cell_count);
+    u32 *marks = Arena_Alloc(&focus->arena, u32, focus->ray_count);
+    FocusIndices stack = { 0 };
+    u32 label = 0;
+    for (usize c = 0; c < cell_count; c++) {
+        if (labels[c] != 0 || focus->spans[c].count < FOCUS_MIN_CELL_CROSSINGS) continue;
+        Focus_Cluster(focus, c, ++label, labels, marks, &stack);
+    }
+
+    qsort(focus->points.data, focus->points.length, sizeof(FocalPoint), FocalPoint_Compare);
+    return focus->points.length;
+}
+
+// Writes a table of the focal points, brightest first.
+void Focus_Print(Focus *focus, FILE *file) {
+    fprintf(file, "%zu focal points from %zu crossings\n", focus->points.length, focus->crossing_count);
+    fprintf(file, "%5s %9s %9s %9s %11s %7s %9s\n", "", "x", "y", "spot", "intensity", "rays", "crossings");
+    for (usize i = 0; i < focus->points.length; i++) {
+        FocalPoint *point = focus->points.data + i;
+        fprintf(file, "%5zu %9.2f %9.2f %9.3f %11.2f %7u %9u\n",
+            i, point->point.x, point->point.y, point->spot, point->intensity, point->ray_count, point->crossings);
+    }
+}
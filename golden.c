@@ -0,0 +1,373 @@
+////////////
+// GOLDEN //
+////////////
+
+// Regression tests for the tracer. Traces the scenes in tests.c and compares
+// the segments against the golden outputs stored in `golden/`, within a
+// tolerance. Each scene is traced three ways: by trace_scene on one thread, by
+// the Tracer on every thread and through a TraceCache, then once more with each
+// of the other accelerators, with lens runs traced by their transfer matrices
+// and after a round trip through a scene file. So a change to the kernels, the
+// BVH or grid, the threading, the cache, the matrices or the scene file format
+// that alters the output fails here before anyone has to spot it in a window.
+// Scenes with light sources are also refined (see refine.c) and checked against
+// a second golden output. Last, the focal point of the lens scene is found (see
+// focus.c) and checked against where a thin lens puts it, and so is the focal
+// length a sweep of the lens picks (see sweep.c).
+//
+// Every scene reports the largest deviation of a segment endpoint (in pixels)
+// and of an intensity from the golden output. These numbers show what a
+// precision tradeoff (float vs double, fast-math) actually costs.
+//
+// usage: ./build/golden [--update] [tolerance]
+//
+// --update rewrites the golden outputs from the current tracer instead of
+// checking against them.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/random.c"
+#include "lib/threads.c"
+
+#include "constants.c"
+#include "lines.c"
+#include "scene.c"
+#include "scenefile.c"
+#include "trace.c"
+#include "cache.c"
+#include "refine.c"
+#include "focus.c"
+#include "sweep.c"
+#include "tests.c"
+
+typedef struct {
+    char *name;
+    bool failed;
+    usize segments;
+    usize golden_segments;
+    f32 max_endpoint;
+    f32 max_intensity;
+    // first segment that differs beyond the tolerance, if any
+    usize first_mismatch;
+} GoldenResult;
+
+// Golden outputs are text, one segment per line, so a change to them shows up
+// readably in a diff. %.9g prints every float exactly.
+static bool golden_write(char *path, LightLines *light_lines) {
+    FILE *file = fopen(path, "w");
+    if (!file) return false;
+    fprintf(file, "segments %zu\n", light_lines->length);
+    for (usize i = 0; i < light_lines->length; i++) {
+        LightLine *light_line = light_lines->data + i;
+        fprintf(file, "%.9g %.9g %.9g %.9g %.9g %.9g\n",
+            light_line->line.start.x, light_line->line.start.y,
+            light_line->line.end.x, light_line->line.end.y,
+            light_line->intensity, light_line->wavelength);
+    }
+    return fclose(file) == 0;
+}
+
+static bool golden_read(char *path, LightLines *light_lines, Arena *arena) {
+    FILE *file = fopen(path, "r");
+    if (!file) return false;
+
+    usize count;
+    bool valid = fscanf(file, "segments %zu", &count) == 1;
+    for (usize i = 0; valid && i < count; i++) {
+        LightLine *light_line = List_Push(light_lines, arena);
+        *light_line = (LightLine) { .component = TRACE_NO_COMPONENT };
+        valid = fscanf(file, "%f %f %f %f %f %f",
+            &light_line->line.start.x, &light_line->line.start.y,
+            &light_line->line.end.x, &light_line->line.end.y,
+            &light_line->intensity, &light_line->wavelength) == 6;
+    }
+
+    fclose(file);
+    return valid;
+}
+
+// Compares `light_lines` against `golden`, keeping the worst deviations in
+// `result`.
+static void golden_compare(GoldenResult *result, LightLines *light_lines, LightLines *golden, f32 tolerance) {
+    result->segments = light_lines->length;
+    result->golden_segments = golden->length;
+    if (light_lines->length != golden->length) result->failed = true;
+
+    usize count = light_lines->length < golden->length ? light_lines->length : golden->length;
+    for (usize i = 0; i < count; i++) {
+        LightLine *a = light_lines->data + i;
+        LightLine *b = golden->data + i;
+        f32 endpoint = fmaxf(Vector2_Distance(&a->line.start, &b->line.start), Vector2_Distance(&a->line.end, &b->line.end));
+        f32 intensity = fabsf(a->intensity - b->intensity);
+        // NaN compares false, so check for a good match rather than a bad one
+        bool matches = endpoint <= tolerance && intensity <= tolerance && a->wavelength == b->wavelength;
+
+        result->max_endpoint = fmaxf(result->max_endpoint, endpoint);
+        result->max_intensity = fmaxf(result->max_intensity, intensity);
+        if (!matches && !result->failed) result->first_mismatch = i;
+        if (!matches) result->failed = true;
+    }
+    if (!result->failed) result->first_mismatch = (usize) -1;
+}
+
+// Traces `scene` every way and checks each against the golden output, or
+// writes the golden output if `update` is set.
+static GoldenResult golden_run(char *name, Scene *scene, Tracer *tracer, bool update, f32 tolerance) {
+    GoldenResult result = { .name = name, .first_mismatch = (usize) -1 };
+    char path[256];
+    snprintf(path, sizeof(path), "golden/%s.txt", name);
+
+    Arena arena = { 0 };
+    LightLines reference = { 0 };
+    TraceStats stats = { 0 };
+    trace_scene(scene, &reference, &stats, &arena);
+
+    if (update) {
+        result.failed = !golden_write(path, &reference);
+        result.segments = result.golden_segments = reference.length;
+        Arena_Free(&arena);
+        return result;
+    }
+
+    LightLines golden = { 0 };
+    if (!golden_read(path, &golden, &arena)) {
+        fprintf(stderr, "%s: missing or unreadable golden output %s\n", name, path);
+        result.failed = true;
+        Arena_Free(&arena);
+        return result;
+    }
+
+    LightLines parallel = { 0 };
+    Tracer_Trace(tracer, scene, &parallel, &stats, &arena);
+    TraceCache cache = { 0 };
+    LightLines cached = { 0 };
+    TraceCache_Update(&cache, tracer, scene, &cached, &arena);
+
+    golden_compare(&result, &reference, &golden, tolerance);
+    golden_compare(&result, &parallel, &golden, tolerance);
+    golden_compare(&result, &cached, &golden, tolerance);
+
+    for (Accelerator accelerator = ACCELERATOR_BVH + 1; accelerator < ACCELERATOR_COUNT; accelerator++) {
+        scene->accelerator = accelerator;
+        LightLines other = { 0 };
+        trace_scene(scene, &other, &stats, &arena);
+        golden_compare(&result, &other, &golden, tolerance);
+    }
+    scene->accelerator = ACCELERATOR_BVH;
+
+    // and with lens runs carried by their matrices, one ray at a time and in
+    // packets
+    scene->paraxial.enabled = true;
+    LightLines paraxial = { 0 };
+    trace_scene(scene, &paraxial, &stats, &arena);
+    golden_compare(&result, &paraxial, &golden, tolerance);
+    LightLines paraxial_parallel = { 0 };
+    Tracer_Trace(tracer, scene, &paraxial_parallel, &stats, &arena);
+    golden_compare(&result, &paraxial_parallel, &golden, tolerance);
+    scene->paraxial.enabled = false;
+
+    // the tests save bare rays or sources but never both, so a loaded scene
+    // has its rays in the same order
+    Scene loaded = Scene_New();
+    if (!Scene_Save(scene, GOLDEN_SCENE_PATH, &arena) || !Scene_Load(&loaded, GOLDEN_SCENE_PATH)) {
+        fprintf(stderr, "%s: could not save and load %s\n", name, GOLDEN_SCENE_PATH);
+        result.failed = true;
+    } else {
+        LightLines reloaded = { 0 };
+        trace_scene(&loaded, &reloaded, &stats, &arena);
+        golden_compare(&result, &reloaded, &golden, tolerance);
+    }
+    Scene_Free(&loaded);
+
+    TraceCache_Free(&cache);
+    Arena_Free(&arena);
+    return result;
+}
+
+// Refines the sources of `scene` and checks the result against its own golden
+// output, or writes that if `update` is set.
+static GoldenResult golden_refine(char *name, Scene *scene, Tracer *tracer, bool update, f32 tolerance) {
+    GoldenResult result = { .name = name, .first_mismatch = (usize) -1 };
+    char path[256];
+    snprintf(path, sizeof(path), "golden/%s.txt", name);
+
+    Arena arena = { 0 };
+    TraceCache cache = { 0 };
+    LightLines cached = { 0 };
+    TraceCache_Update(&cache, tracer, scene, &cached, &arena);
+    Refine refine;
+    Refine_Init(&refine, GOLDEN_REFINE_BUDGET);
+    Refine_Run(&refine, tracer, scene, &cache);
+
+    LightLines golden = { 0 };
+    if (update) {
+        result.failed = !golden_write(path, &refine.light_lines);
+        result.segments = result.golden_segments = refine.light_lines.length;
+    } else if (!golden_read(path, &golden, &arena)) {
+        fprintf(stderr, "%s: missing or unreadable golden output %s\n", name, path);
+        result.failed = true;
+    } else {
+        golden_compare(&result, &refine.light_lines, &golden, tolerance);
+    }
+
+    Refine_Free(&refine);
+    TraceCache_Free(&cache);
+    Arena_Free(&arena);
+    return result;
+}
+
+// The parallel rays of the lens scene should meet in a single focal point,
+// one focal length past the middle of the lens. There is no golden output to
+// write: `max_endpoint` is the distance from there, and `segments` the rays
+// that met against the rays of the scene.
+static GoldenResult golden_focus(Tracer *tracer, f32 tolerance) {
+    GoldenResult result = { .name = "lens_focus", .first_mismatch = (usize) -1 };
+    Arena arena = { 0 };
+    Scene scene = Scene_New();
+    test_load(&scene, "lens");
+    Vector2 expected = { 500 + 300, 400 };
+
+    TraceCache cache = { 0 };
+    LightLines cached = { 0 };
+    TraceCache_Update(&cache, tracer, &scene, &cached, &arena);
+    Focus focus;
+    Focus_Init(&focus, &tracer->pool, &arena);
+    Focus_Begin(&focus);
+    Focus_AddCache(&focus, &scene, &cache);
+    Focus_Run(&focus);
+
+    result.golden_segments = scene.light_rays.length;
+    if (focus.points.length != 1) {
+        fprintf(stderr, "lens_focus: found %zu focal points, expected 1\n", focus.points.length);
+        result.failed = true;
+    } else {
+        FocalPoint *point = focus.points.data;
+        result.segments = point->ray_count;
+        result.max_endpoint = Vector2_Distance(&point->point, &expected);
+        // NaN compares false, so check for a good match rather than a bad one
+        bool matches = result.max_endpoint <= tolerance && result.segments == result.golden_segments;
+        result.failed = !matches;
+    }
+
+    Focus_Free(&focus);
+    TraceCache_Free(&cache);
+    Scene_Free(&scene);
+    Arena_Free(&arena);
+    return result;
+}
+
+// A sweep of the lens's focal length, scored at a target one focal length
+// past the lens, should rank the scene's own focal length first with every
+// ray crossing in one point. `max_endpoint` is the spot size of the best
+// variant, and `segments` its rays crossing the target.
+static GoldenResult golden_sweep(f32 tolerance) {
+    GoldenResult result = { .name = "lens_sweep", .first_mismatch = (usize) -1 };
+    Arena arena = { 0 };
+    Line target = { { 800, 100 }, { 800, 700 } };
+    Sweep sweep;
+    Sweep_Init(&sweep, Threads_Count(), &target, &arena);
+    SweepParameter parameter = { .kind = SWEEP_FOCAL_LENGTH, .from.x = 200, .to.x = 400, .steps = GOLDEN_SWEEP_STEPS };
+    if (!Sweep_Load(&sweep, "lens") || !Sweep_AddParameter(&sweep, &parameter)) {
+        fprintf(stderr, "lens_sweep: could not set up the sweep\n");
+        result.failed = true;
+    } else {
+        Sweep_Run(&sweep);
+        SweepResult *best = sweep.results;
+        result.segments = best->hits;
+        result.golden_segments = sweep.workers[0].scene.light_rays.length;
+        result.max_endpoint = best->spot;
+        bool matches = best->spot <= tolerance && Sweep_Value(&sweep, best->variant, 0).x == 300
+            && result.segments == result.golden_segments;
+        result.failed = !matches;
+    }
+
+    Sweep_Free(&sweep);
+    Arena_Free(&arena);
+    return result;
+}
+
+static void golden_report(GoldenResult *result, bool update) {
+    if (update) {
+        printf("%-20s %s (%zu segments)\n", result->name, result->failed ? "FAILED TO WRITE" : "written", result->segments);
+        return;
+    }
+    printf("%-20s %s  segments %zu/%zu  max endpoint %.3g px  max intensity %.3g\n",
+        result->name, result->failed ? "FAIL" : "ok  ", result->segments, result->golden_segments,
+        result->max_endpoint, result->max_intensity);
+    if (result->first_mismatch != (usize) -1) {
+        printf("%-20s first mismatch at segment %zu\n", "", result->first_mismatch);
+    }
+}
+
+i32 main(i32 argc, char **argv) {
+    bool update = argc > 1 && strcmp(argv[1], "--update") == 0;
+    char *tolerance_arg = argc > 1 + update ? argv[1 + update] : NULL;
+    f32 tolerance = tolerance_arg ? atof(tolerance_arg) : GOLDEN_TOLERANCE;
+
+    Arena arena = { 0 };
+    Tracer tracer;
+    Tracer_Init(&tracer, Threads_Count(), &arena);
+
+    char *fixed[] = { "mirror", "lens", "lens_2", "cavity", "update", "dispersion", "lights" };
+    usize fixed_count = sizeof(fixed) / sizeof(*fixed);
+    usize count = fixed_count + TEST_SCENE_COUNT;
+
+    usize failures = 0, checked = 0;
+    f32 max_endpoint = 0, max_intensity = 0;
+    for (usize i = 0; i < count; i++) {
+        Scene scene = Scene_New();
+        char name[64];
+        if (i < fixed_count) {
+            snprintf(name, sizeof(name), "%s", fixed[i]);
+            test_load(&scene, name);
+        } else {
+            TestSceneEntry *entry = TEST_SCENES + i - fixed_count;
+            snprintf(name, sizeof(name), "%s_%zu", entry->name, (usize) GOLDEN_SCENE_SIZE);
+            // seeded by the generator, so adding fixed scenes leaves these be
+            Random random = Random_New(i - fixed_count);
+            entry->generate(&scene, GOLDEN_SCENE_SIZE, GOLDEN_SCENE_RAYS, &random);
+        }
+
+        GoldenResult results[2];
+        usize result_count = 0;
+        results[result_count++] = golden_run(name, &scene, &tracer, update, tolerance);
+        char refined[80];
+        if (scene.point_lights.length > 0 || scene.line_lights.length > 0) {
+            snprintf(refined, sizeof(refined), "%s_refined", name);
+            results[result_count++] = golden_refine(refined, &scene, &tracer, update, tolerance);
+        }
+        Scene_Free(&scene);
+
+        for (usize j = 0; j < result_count; j++) {
+            GoldenResult *result = results + j;
+            checked++;
+            failures += result->failed;
+            max_endpoint = fmaxf(max_endpoint, result->max_endpoint);
+            max_intensity = fmaxf(max_intensity, result->max_intensity);
+            golden_report(result, update);
+        }
+    }
+
+    if (!update) {
+        GoldenResult results[] = { golden_focus(&tracer, tolerance), golden_sweep(tolerance) };
+        for (usize j = 0; j < sizeof(results) / sizeof(*results); j++) {
+            checked++;
+            failures += results[j].failed;
+            max_endpoint = fmaxf(max_endpoint, results[j].max_endpoint);
+            golden_report(results + j, update);
+        }
+        printf("%zu of %zu scenes failed (tolerance %g)  max endpoint %.3g px  max intensity %.3g\n",
+            failures, checked, tolerance, max_endpoint, max_intensity);
+    }
+
+    Tracer_Free(&tracer);
+    Arena_Free(&arena);
+    return failures > 0;
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/vectors.c"
+#include "constants.c"
+#include "lines.c"
+#include "components.c"
+#include "segments.c"
+#include "binning.c"
+
+// Uniform grid over the bounds of every component, as an alternative to the
+// BVH for scenes of many short, evenly spread segments (diffusers, facet
+// arrays). Each segment is binned into every cell it passes through, and a ray
+// walks the cells in order with a 2D DDA, testing each cell with the SIMD
+// kernels in segments.c and stopping at the first cell that ends past the
+// closest hit so far.
+//
+// Every cell's segments are stored contiguously in an SoA copy, so a segment
+// crossing several cells is copied into each. The grid has no incremental
+// updates: any edit marks it stale and the next Grid_Update rebuilds it, which
+// is a couple of linear passes.
+
+typedef struct {
+    u32 index;
+    ComponentKind kind;
+} GridItem;
+
+typedef struct {
+    GridItem *data;
+    usize length;
+    usize capacity;
+} GridItems;
+
+typedef struct {
+    u32 *data;
+    usize length;
+    usize capacity;
+} GridCells;
+
+// Cell (column, row) covers [min + (column, row) * cell_size, min + (column +
+// 1, row + 1) * cell_size) and owns the segments in [cells[c], cells[c + 1]),
+// where c = row * columns + column.
+typedef struct {
+    Vector2 min;
+    f32 cell_size;
+    u32 columns;
+    u32 rows;
+    GridCells cells;
+    GridItems items;
+    Segments segments;
+    usize component_count;
+    bool stale;
+    bool built;
+} Grid;
+
+// Aims for about GRID_SEGMENTS_PER_CELL segments per cell over the bounds,
+// but keeps cells large enough that an average segment spans at most
+// GRID_CELLS_PER_SEGMENT of them, and the grid under GRID_MAX_CELLS cells.
+static f32 Grid_CellSize(Vector2 *size, usize count, f32 mean_length) {
+    f32 cell_size = sqrtf(size->x * size->y * GRID_SEGMENTS_PER_CELL / count);
+    if (cell_size < mean_length / GRID_CELLS_PER_SEGMENT) cell_size = mean_length / GRID_CELLS_PER_SEGMENT;
+    f32 min_size = sqrtf(size->x * size->y / GRID_MAX_CELLS);
+    if (cell_size < min_size) cell_size = min_size;
+    // all segments on one point or one axis-parallel line
+    if (!(cell_size > GRID_MARGIN)) cell_size = size->x > size->y ? size->x : size->y;
+    if (!(cell_size > GRID_MARGIN)) cell_size = 1;
+    return cell_size;
+}
+
+// What Grid_Build bins, for the binning callbacks.
+typedef struct {
+    Grid *grid;
+    Components *components;
+} GridBuild;
+
+static Line *Grid_Line(void *context, usize item) {
+    GridBuild *build = context;
+    return &Components_Get(build->components, item)->line;
+}
+
+static void Grid_Place(void *context, usize item, u32 slot) {
+    GridBuild *build = context;
+    Component *component = Components_Get(build->components, item);
+    Segments_Set(&build->grid->segments, slot, &component->line);
+    build->grid->items.data[slot] = (GridItem) { .index = item, .kind = component->kind };
+}
+
+// Rebuilds the grid from scratch, reusing the memory of the last build.
+void Grid_Build(Grid *grid, Components *components, Arena *arena) {
+    Vector2 min = { FLT_MAX, FLT_MAX };
+    Vector2 max = { -FLT_MAX, -FLT_MAX };
+    f32 total_length = 0;
+    for (usize i = 0; i < components->length; i++) {
+        Line *line = &Components_Get(components, i)->line;
+        min.x = fminf(min.x, fminf(line->start.x, line->end.x));
+        min.y = fminf(min.y, fminf(line->start.y, line->end.y));
+        max.x = fmaxf(max.x, fmaxf(line->start.x, line->end.x));
+        max.y = fmaxf(max.y, fmaxf(line->start.y, line->end.y));
+        total_length += Vector2_Distance(&line->start, &line->end);
+    }
+
+    grid->component_count = components->length;
+    grid->stale = false;
+    grid->built = true;
+    grid->columns = grid->rows = 0;
+    grid->cells.length = 0;
+    grid->items.length = 0;
+    if (components->length == 0) return;
+
+    grid->min = (Vector2) { min.x - GRID_MARGIN, min.y - GRID_MARGIN };
+    Vector2 size = { max.x - min.x + 2 * GRID_MARGIN, max.y - min.y + 2 * GRID_MARGIN };
+    grid->cell_size = Grid_CellSize(&size, components->length, total_length / components->length);
+    grid->columns = ceilf(size.x / grid->cell_size);
+    grid->rows = ceilf(size.y / grid->cell_size);
+
+    Binning binning = { grid->min, grid->cell_size, grid->columns, grid->rows, GRID_MARGIN };
+    usize cell_count = (usize) grid->columns * grid->rows;
+    List_Reserve(&grid->cells, cell_count + 1, arena);
+    grid->cells.length = cell_count + 1;
+    GridBuild build = { grid, components };
+    u32 total = Binning_Count(&binning, grid->cells.data, components->length, Grid_Line, &build);
+
+    Segments_Resize(&grid->segments, total, arena);
+    List_Reserve(&grid->items, total, arena);
+    grid->items.length = total;
+    Binning_Place(&binning, grid->cells.data, components->length, Grid_Line, Grid_Place, &build);
+}
+
+// Rebuilds the grid if components were added, moved or removed since the last
+// build.
+void Grid_Update(Grid *grid, Components *components, Arena *arena) {
+    if (grid->built && !grid->stale && grid->component_count == components->length) return;
+    Grid_Build(grid, components, arena);
+}
+
+// Finds the nearest component hit by `ray`. Returns false and leaves
+// `hit->kind` as COMPONENT_NONE if nothing is hit.
+bool Grid_Closest(Grid *grid, Ray *ray, Hit *hit) {
+    *hit = (Hit) { .kind = COMPONENT_NONE, .index = (usize) -1, .point = { NAN, NAN }, .distance = FLT_MAX };
+    if (grid->items.length == 0) return false;
+
+    SegmentsKernel kernel = Segments_Kernel();
+    Vector2 direction = Ray_ToVector(ray);
+    Vector2 *start = &ray->start;
+
+    // clip the ray to the grid's bounds
+    f32 width = grid->columns * grid->cell_size;
+    f32 height = grid->rows * grid->cell_size;
+    f32 t_enter = 0, t_leave = FLT_MAX;
+    if (direction.x != 0) {
+        f32 t_0 = (grid->min.x - start->x) / direction.x;
+        f32 t_1 = (grid->min.x + width - start->x) / direction.x;
+        t_enter = fmaxf(t_enter, fminf(t_0, t_1));
+        t_leave = fminf(t_leave, fmaxf(t_0, t_1));
+    } else if (start->x < grid->min.x || start->x > grid->min.x + width) {
+        return false;
+    }
+    if (direction.y != 0) {
+        f32 t_0 = (grid->min.y - start->y) / direction.y;
+        f32 t_1 = (grid->min.y + height - start->y) / direction.y;
+        t_enter = fmaxf(t_enter, fminf(t_0, t_1));
+        t_leave = fminf(t_leave, fmaxf(t_0, t_1));
+    } else if (start->y < grid->min.y || start->y > grid->min.y + height) {
+        return false;
+    }
+    if (t_enter > t_leave) return false;
+
+    f32 inverse = 1 / grid->cell_size;
+    i32 column = Binning_Clamp((start->x + direction.x * t_enter - grid->min.x) * inverse, grid->columns);
+    i32 row = Binning_Clamp((start->y + direction.y * t_enter - grid->min.y) * inverse, grid->rows);
+
+    // distance along the ray to the next column and row border, and between
+    // borders
+    i32 step_x = direction.x > 0 ? 1 : -1;
+    i32 step_y = direction.y > 0 ? 1 : -1;
+    f32 t_x = FLT_MAX, t_y = FLT_MAX, delta_x = FLT_MAX, delta_y = FLT_MAX;
+    if (direction.x != 0) {
+        t_x = (grid->min.x + (column + (step_x > 0)) * grid->cell_size - start->x) / direction.x;
+        delta_x = grid->cell_size / fabsf(direction.x);
+    }
+    if (direction.y != 0) {
+        t_y = (grid->min.y + (row + (step_y > 0)) * grid->cell_size - start->y) / direction.y;
+        delta_y = grid->cell_size / fabsf(direction.y);
+    }
+
+    for (;;) {
+        u32 cell = row * grid->columns + column;
+        u32 first = grid->cells.data[cell];
+        u32 count = grid->cells.data[cell + 1] - first;
+        if (count > 0) {
+            hit->tests += count;
+            usize i = kernel(&grid->segments, first, count, start, &direction, &hit->distance);
+            if (i != (usize) -1) {
+                hit->kind = grid->items.data[i].kind;
+                hit->index = grid->items.data[i].index;
+            }
+        }
+
+        // later cells can't hold anything closer
+        if (hit->distance <= fminf(t_x, t_y)) break;
+        if (t_x < t_y) {
+            column += step_x;
+            if (column < 0 || column >= (i32) grid->columns) break;
+            t_x += delta_x;
+        } else {
+            row += step_y;
+            if (row < 0 || row >= (i32) grid->rows) break;
+            t_y += delta_y;
+        }
+    }
+
+    if (hit->kind == COMPONENT_NONE) return false;
+    hit->point = (Vector2) {
+        start->x + direction.x * hit->distance,
+        start->y + direction.y * hit->distance
+    };
+    return true;
+}
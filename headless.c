@@ -0,0 +1,179 @@
+//////////////
+// HEADLESS //
+//////////////
+
+// Traces a scene without opening a window, so the tracer can run on machines
+// without a display and be timed without vsync getting in the way.
+//
+// usage: ./build/headless [scene] [iterations] [threads] [trace file] [accelerator]
+//
+// `scene` is either the name of a scene in tests.c or a scene file saved from
+// the app with [S]. Given a trace file other than "-", every iteration is
+// streamed into it (see export.c). `accelerator` is bvh (the default), grid or
+// brute.
+//
+// usage: ./build/headless --sweep [scene] [target] [parameter...]
+//
+// Sweeps the scene over every combination of the parameters on every thread
+// and prints the SWEEP_TOP variants whose rays cross the line `target`
+// (x0,y0,x1,y1) most tightly (see sweep.c). For example, to try nine focal
+// lengths for the lens of the lens scene:
+//
+//     ./build/headless --sweep lens 800,100,800,700 focal:0:200:400:9
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/clock.c"
+#include "lib/threads.c"
+
+#include "constants.c"
+#include "lines.c"
+#include "optics.c"
+#include "lights.c"
+#include "scene.c"
+#include "scenefile.c"
+#include "trace.c"
+#include "export.c"
+#include "sweep.c"
+#include "tests.c"
+
+static i32 headless_sweep(i32 argc, char **argv) {
+    char *name = argc > 0 ? argv[0] : "lens";
+    char *target_arg = argc > 1 ? argv[1] : "800,100,800,700";
+    Line target;
+    i32 consumed = 0;
+    sscanf(target_arg, "%f,%f,%f,%f%n", &target.start.x, &target.start.y, &target.end.x, &target.end.y, &consumed);
+    if (consumed == 0 || target_arg[consumed] != '\0') {
+        fprintf(stderr, "target must be x0,y0,x1,y1: %s\n", target_arg);
+        return 1;
+    }
+
+    Arena arena = { 0 };
+    Sweep sweep;
+    Sweep_Init(&sweep, Threads_Count(), &target, &arena);
+    bool valid = Sweep_Load(&sweep, name);
+    if (!valid) fprintf(stderr, "unknown scene: %s\n", name);
+    for (i32 i = 2; valid && i < argc; i++) {
+        SweepParameter parameter;
+        valid = SweepParameter_Parse(argv[i], &parameter) && Sweep_AddParameter(&sweep, &parameter);
+        if (!valid) fprintf(stderr, "bad parameter for this scene: %s\n", argv[i]);
+    }
+    if (!valid) {
+        Sweep_Free(&sweep);
+        Arena_Free(&arena);
+        return 1;
+    }
+
+    f64 start = Clock_Now();
+    Sweep_Run(&sweep);
+    f64 elapsed = Clock_Now() - start;
+
+    Sweep_Print(&sweep, SWEEP_TOP, stdout);
+    printf("scene:             %s\n", name);
+    printf("variants:          %zu\n", sweep.variant_count);
+    printf("threads:           %zu\n", sweep.pool.count);
+    printf("time:              %.6f s\n", elapsed);
+    printf("variants/sec:      %.0f\n", sweep.variant_count / elapsed);
+
+    Sweep_Free(&sweep);
+    Arena_Free(&arena);
+    return 0;
+}
+
+i32 main(i32 argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--sweep") == 0) return headless_sweep(argc - 2, argv + 2);
+
+    char *name = argc > 1 ? argv[1] : "update";
+    i32 iterations = argc > 2 ? atoi(argv[2]) : 1000;
+    i32 threads = argc > 3 ? atoi(argv[3]) : (i32) Threads_Count();
+    char *trace_path = argc > 4 && strcmp(argv[4], "-") != 0 ? argv[4] : NULL;
+    char *accelerator_name = argc > 5 ? argv[5] : ACCELERATOR_NAMES[ACCELERATOR_BVH];
+    Accelerator accelerator = 0;
+    while (accelerator < ACCELERATOR_COUNT && strcmp(ACCELERATOR_NAMES[accelerator], accelerator_name) != 0) accelerator++;
+    if (accelerator == ACCELERATOR_COUNT) {
+        fprintf(stderr, "unknown accelerator: %s\n", accelerator_name);
+        return 1;
+    }
+    if (iterations <= 0 || threads <= 0) {
+        fprintf(stderr, "iterations and threads must be positive\n");
+        return 1;
+    }
+
+    Arena arena = Arena_New(1024 * 1014);
+    Arena frame = { 0 };
+    Scene scene = Scene_New();
+    LightLines light_lines = { 0 };
+    TraceStats stats = { 0 };
+    Tracer tracer;
+    Tracer_Init(&tracer, threads, &arena);
+
+    f64 load_start = Clock_Now();
+    if (!test_load(&scene, name) && !Scene_Load(&scene, name)) {
+        fprintf(stderr, "unknown scene: %s\n", name);
+        Tracer_Free(&tracer);
+        Scene_Free(&scene);
+        Arena_Free(&arena);
+        return 1;
+    }
+
+    f64 load_time = Clock_Now() - load_start;
+    scene.accelerator = accelerator;
+
+    TraceExport export;
+    if (trace_path && !TraceExport_Open(&export, trace_path)) {
+        fprintf(stderr, "could not create %s\n", trace_path);
+        trace_path = NULL;
+    }
+
+    f64 start = Clock_Now();
+    for (i32 i = 0; i < iterations; i++) {
+        Arena_Reset(&frame);
+        light_lines = (LightLines) { 0 };
+        Tracer_Trace(&tracer, &scene, &light_lines, &stats, &frame);
+
+        if (!trace_path) continue;
+        usize first = 0;
+        for (usize r = 0; r < scene.light_rays.length; r++) {
+            usize count = tracer.spans[r].count;
+            TraceExport_AddRay(&export, r, light_lines.data + first, count);
+            first += count;
+        }
+        TraceExport_EndFrame(&export);
+    }
+    f64 elapsed = Clock_Now() - start;
+
+    bool exported = trace_path && TraceExport_Close(&export);
+    if (trace_path && !exported) fprintf(stderr, "could not write %s\n", trace_path);
+
+    printf("scene:             %s\n", name);
+    printf("iterations:        %d\n", iterations);
+    printf("threads:           %d\n", threads);
+    printf("accelerator:       %s\n", ACCELERATOR_NAMES[accelerator]);
+    printf("components:        %zu\n", scene.components.length);
+    printf("load time:         %.6f s\n", load_time);
+    printf("rays:              %zu\n", stats.rays);
+    printf("segments:          %zu\n", stats.segments);
+    printf("bounces:           %zu\n", stats.bounces);
+    printf("tests:             %zu\n", stats.intersection_tests);
+    printf("bounce cutoffs:    %zu\n", stats.bounce_cutoffs);
+    printf("intensity cutoffs: %zu\n", stats.intensity_cutoffs);
+    printf("time:              %.6f s\n", elapsed);
+    printf("rays/sec:          %.0f\n", stats.rays / elapsed);
+    printf("segments/sec:      %.0f\n", stats.segments / elapsed);
+    if (exported) {
+        printf("trace file:        %s\n", trace_path);
+        printf("export stalls:     %zu\n", export.stalls);
+    }
+
+    Tracer_Free(&tracer);
+    Scene_Free(&scene);
+    Arena_Free(&frame);
+    Arena_Free(&arena);
+    return 0;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/threads.c"
+#include "lib/raylib.c"
+#include "constants.c"
+#include "lines.c"
+#include "spectrum.c"
+#include "trace.c"
+
+// Accumulates how much light reaches each pixel. Every light line is splatted
+// into a float RGB buffer as an antialiased line weighted by its intensity,
+// its color (see Spectrum_Color) and the length of the line inside each pixel
+// column or row, i.e. a track-length estimate of the light passing through
+// the pixel.
+//
+// The buffer is split into tiles. Workers first bin line indices into the
+// tiles they cross (each worker into its own bins), then rasterize one tile
+// at a time, so no two threads ever write the same pixel.
+
+typedef struct {
+    u32 *data;
+    usize length;
+    usize capacity;
+} TileBin;
+
+typedef struct {
+    u32 width;
+    u32 height;
+    u32 tiles_x;
+    u32 tiles_y;
+    // three floats per pixel, red, green and blue
+    f32 *pixels;
+    Color *colors;
+
+    ThreadPool *pool;
+    Arena storage;
+    Arena *arenas;
+    TileBin *bins;
+
+    // only valid during Irradiance_Splat and Irradiance_ToneMap
+    LightLines *light_lines;
+    f32 exposure;
+} Irradiance;
+
+void Irradiance_Init(Irradiance *irradiance, u32 width, u32 height, ThreadPool *pool, Arena *arena) {
+    *irradiance = (Irradiance) {
+        .width = width,
+        .height = height,
+        .tiles_x = (width + IRRADIANCE_TILE_SIZE - 1) / IRRADIANCE_TILE_SIZE,
+        .tiles_y = (height + IRRADIANCE_TILE_SIZE - 1) / IRRADIANCE_TILE_SIZE,
+        .pool = pool
+    };
+
+    // the buffers live exactly as long as the map, so they get their own arena
+    irradiance->storage = Arena_New(width * height * (3 * sizeof(f32) + sizeof(Color)) + 64);
+    irradiance->pixels = Arena_AllocAlign(&irradiance->storage, sizeof(f32), 64, 3 * width * height, 0);
+    irradiance->colors = Arena_Alloc(&irradiance->storage, Color, width * height);
+    irradiance->arenas = Arena_Alloc(arena, Arena, pool->count);
+    irradiance->bins = Arena_Alloc(arena, TileBin, pool->count * irradiance->tiles_x * irradiance->tiles_y);
+    for (usize i = 0; i < pool->count; i++) {
+        irradiance->arenas[i] = Arena_New(IRRADIANCE_ARENA_CAPACITY);
+    }
+}
+
+void Irradiance_Free(Irradiance *irradiance) {
+    Arena_Free(&irradiance->storage);
+    for (usize i = 0; i < irradiance->pool->count; i++) Arena_Free(irradiance->arenas + i);
+}
+
+void Irradiance_Clear(Irradiance *irradiance) {
+    memset(irradiance->pixels, 0, 3 * irradiance->width * irradiance->height * sizeof(f32));
+}
+
+static void Irradiance_BinChunk(void *context, usize chunk, usize worker) {
+    Irradiance *irradiance = context;
+    LightLines *light_lines = irradiance->light_lines;
+    usize tiles = irradiance->tiles_x * irradiance->tiles_y;
+    TileBin *bins = irradiance->bins + worker * tiles;
+    f32 tile_size = IRRADIANCE_TILE_SIZE;
+    Vector2 bounds_min = { -1, -1 };
+    Vector2 bounds_max = { irradiance->width + 1, irradiance->height + 1 };
+
+    usize first = chunk * IRRADIANCE_CHUNK_SIZE;
+    usize last = first + IRRADIANCE_CHUNK_SIZE < light_lines->length ? first + IRRADIANCE_CHUNK_SIZE : light_lines->length;
+    for (usize i = first; i < last; i++) {
+        Line line = light_lines->data[i].line;
+        if (!Line_Clip(&line, &bounds_min, &bounds_max)) continue;
+
+        // a line touches pixels up to one away from it
+        i32 tile_x0 = fmaxf(0, floorf((fminf(line.start.x, line.end.x) - 1) / tile_size));
+        i32 tile_y0 = fmaxf(0, floorf((fminf(line.start.y, line.end.y) - 1) / tile_size));
+        i32 tile_x1 = fminf(irradiance->tiles_x - 1, floorf((fmaxf(line.start.x, line.end.x) + 1) / tile_size));
+        i32 tile_y1 = fminf(irradiance->tiles_y - 1, floorf((fmaxf(line.start.y, line.end.y) + 1) / tile_size));
+
+        for (i32 tile_y = tile_y0; tile_y <= tile_y1; tile_y++) {
+            for (i32 tile_x = tile_x0; tile_x <= tile_x1; tile_x++) {
+                Vector2 min = { tile_x * tile_size - 1, tile_y * tile_size - 1 };
+                Vector2 max = { (tile_x + 1) * tile_size + 1, (tile_y + 1) * tile_size + 1 };
+                if (!Line_IntersectsBox(&line, &min, &max)) continue;
+                *List_Push(bins + tile_y * irradiance->tiles_x + tile_x, irradiance->arenas + worker) = i;
+            }
+        }
+    }
+}
+
+// Deposits `line` into the pixels of one tile. Steps one pixel at a time along
+// the major axis and splits each step between the two nearest pixels on the
+// minor axis (as in Xiaolin Wu's algorithm). Only pixels inside the tile are
+// touched; the neighbouring tiles cover the rest of the line.
+static void Irradiance_Rasterize(Irradiance *irradiance, Line *line, Vector3 *color, i32 x0, i32 y0, i32 x1, i32 y1) {
+    Vector2 start = line->start, end = line->end;
+    f32 dx = end.x - start.x, dy = end.y - start.y;
+    if (dx == 0 && dy == 0) return;
+
+    bool steep = fabsf(dy) > fabsf(dx);
+    if (steep) {
+        // rasterize the transposed line and transpose back on write
+        start = (Vector2) { start.y, start.x };
+        end = (Vector2) { end.y, end.x };
+        i32 swap = x0; x0 = y0; y0 = swap;
+        swap = x1; x1 = y1; y1 = swap;
+    }
+    if (start.x > end.x) {
+        Vector2 swap = start; start = end; end = swap;
+    }
+
+    f32 slope = (end.y - start.y) / (end.x - start.x);
+    f32 length = sqrtf(1 + slope * slope);
+    Vector3 weight = { color->x * length, color->y * length, color->z * length };
+
+    // pixel centers between the endpoints, restricted to the tile
+    i32 first = ceilf(start.x - 0.5f), last = floorf(end.x - 0.5f);
+    if (first < x0) first = x0;
+    if (last > x1 - 1) last = x1 - 1;
+
+    for (i32 major = first; major <= last; major++) {
+        f32 minor = start.y + slope * (major + 0.5f - start.x) - 0.5f;
+        i32 row = floorf(minor);
+        f32 fraction = minor - row;
+
+        for (i32 k = 0; k < 2; k++) {
+            i32 current = row + k;
+            if (current < y0 || current >= y1) continue;
+
+            f32 coverage = k == 0 ? 1 - fraction : fraction;
+            usize pixel = steep
+                ? (usize) major * irradiance->width + current
+                : (usize) current * irradiance->width + major;
+            f32 *rgb = irradiance->pixels + 3 * pixel;
+            rgb[0] += weight.x * coverage;
+            rgb[1] += weight.y * coverage;
+            rgb[2] += weight.z * coverage;
+        }
+    }
+}
+
+static void Irradiance_RasterizeTile(void *context, usize tile, usize worker) {
+    Irradiance *irradiance = context;
+    usize tiles = irradiance->tiles_x * irradiance->tiles_y;
+    i32 x0 = (tile % irradiance->tiles_x) * IRRADIANCE_TILE_SIZE;
+    i32 y0 = (tile / irradiance->tiles_x) * IRRADIANCE_TILE_SIZE;
+    i32 x1 = x0 + IRRADIANCE_TILE_SIZE < irradiance->width ? x0 + IRRADIANCE_TILE_SIZE : irradiance->width;
+    i32 y1 = y0 + IRRADIANCE_TILE_SIZE < irradiance->height ? y0 + IRRADIANCE_TILE_SIZE : irradiance->height;
+
+    for (usize w = 0; w < irradiance->pool->count; w++) {
+        TileBin *bin = irradiance->bins + w * tiles + tile;
+        for (usize i = 0; i < bin->length; i++) {
+            LightLine *light_line = irradiance->light_lines->data + bin->data[i];
+            Vector3 color = Spectrum_Color(light_line->wavelength);
+            color = (Vector3) { color.x * light_line->intensity, color.y * light_line->intensity, color.z * light_line->intensity };
+            Irradiance_Rasterize(irradiance, &light_line->line, &color, x0, y0, x1, y1);
+        }
+        bin->length = 0;
+    }
+}
+
+// Adds every line in `light_lines` to the buffer.
+void Irradiance_Splat(Irradiance *irradiance, LightLines *light_lines) {
+    irradiance->light_lines = light_lines;
+    usize chunks = (light_lines->length + IRRADIANCE_CHUNK_SIZE - 1) / IRRADIANCE_CHUNK_SIZE;
+    ThreadPool_Run(irradiance->pool, chunks, Irradiance_BinChunk, irradiance);
+    ThreadPool_Run(irradiance->pool, irradiance->tiles_x * irradiance->tiles_y, Irradiance_RasterizeTile, irradiance);
+    irradiance->light_lines = NULL;
+}
+
+static void Irradiance_ToneMapRow(void *context, usize row, usize worker) {
+    Irradiance *irradiance = context;
+    for (usize i = row * irradiance->width; i < (row + 1) * irradiance->width; i++) {
+        // Reinhard on each channel: maps [0, inf) onto [0, 1)
+        u8 levels[3];
+        for (usize c = 0; c < 3; c++) {
+            f32 value = irradiance->exposure * irradiance->pixels[3 * i + c];
+            levels[c] = 255 * value / (1 + value);
+        }
+        irradiance->colors[i] = (Color) { levels[0], levels[1], levels[2], 255 };
+    }
+}
+
+// Converts the buffer into `colors`, ready for UpdateTexture.
+void Irradiance_ToneMap(Irradiance *irradiance, f32 exposure) {
+    irradiance->exposure = exposure;
+    ThreadPool_Run(irradiance->pool, irradiance->height, Irradiance_ToneMapRow, irradiance);
+}
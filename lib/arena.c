@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include "types.c"
 
 // https://nullprogram.com/blog/2023/09/27/
@@ -11,17 +13,39 @@
 #define countof(a)   (sizeof(a) / sizeof(*(a)))
 #define lengthof(s)  (countof(s) - 1)
 
+// An arena is a chain of blocks. Allocations come from the newest block and a
+// full block is followed by one at least twice its size, so an arena never
+// runs out while memory lasts. A zeroed arena is valid and empty.
+
+typedef struct ArenaBlock ArenaBlock;
+
+struct ArenaBlock {
+    ArenaBlock *previous;
+    usize capacity;
+};
+
 typedef struct {
-    void *base;
+    ArenaBlock *block;
     void *start;
     void *end;
 } Arena;
 
+const usize ARENA_MIN_BLOCK = 64 * 1024;
+
+static bool Arena_Push(Arena *arena, usize capacity) {
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + capacity);
+    if (!block) return false;
+
+    *block = (ArenaBlock) { .previous = arena->block, .capacity = capacity };
+    arena->block = block;
+    arena->start = block + 1;
+    arena->end = arena->start + capacity;
+    return true;
+}
+
 Arena Arena_New(usize capacity) {
     Arena a = {0};
-    a.base = malloc(capacity);
-    a.start = a.base;
-    a.end = a.start ? a.start+capacity : 0;
+    Arena_Push(&a, capacity);
     return a;
 }
 
@@ -34,19 +58,49 @@ Arena Arena_New(usize capacity) {
 void *Arena_AllocAlign(Arena *arena, usize size, usize align, u32 count, u8 flags) {
     ptrdiff_t padding = -(uptr) arena->start & (align - 1);
     ptrdiff_t available = arena->end - arena->start - padding;
-    if (available < 0 || count > available / size) { raise(SIGTRAP); }
+    if (available < 0 || count > available / size) {
+        usize needed = size * count + align;
+        usize capacity = arena->block ? 2 * arena->block->capacity : ARENA_MIN_BLOCK;
+        while (capacity < needed) capacity *= 2;
+        if (count > PTRDIFF_MAX / size || !Arena_Push(arena, capacity)) { raise(SIGTRAP); }
+        padding = -(uptr) arena->start & (align - 1);
+    }
 
     void *p = arena->start + padding;
     arena->start += padding + count * size;
     return memset(p, 0, count * size);
 }
 
+// Bytes handed out since the last reset. Older blocks count as full.
+usize Arena_Used(Arena *arena) {
+    if (!arena->block) return 0;
+    usize used = arena->start - (void *) (arena->block + 1);
+    for (ArenaBlock *block = arena->block->previous; block; block = block->previous) used += block->capacity;
+    return used;
+}
+
 void Arena_Free(Arena *arena) {
-    free(arena->base);
-    arena->base = arena->start = arena->end = NULL;
+    while (arena->block) {
+        ArenaBlock *previous = arena->block->previous;
+        free(arena->block);
+        arena->block = previous;
+    }
+    *arena = (Arena) {0};
 }
 
+// Empties the arena. If it had grown past its first block, the blocks are
+// replaced by a single one as big as all of them together, so the next round
+// of allocations fits without growing again.
 void Arena_Reset(Arena *arena) {
-    arena->start = arena->base;
-}
+    if (!arena->block) return;
+
+    if (arena->block->previous) {
+        usize capacity = 0;
+        for (ArenaBlock *block = arena->block; block; block = block->previous) capacity += block->capacity;
+        Arena_Free(arena);
+        if (!Arena_Push(arena, capacity)) { raise(SIGTRAP); }
+        return;
+    }
 
+    arena->start = arena->block + 1;
+}
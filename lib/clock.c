@@ -0,0 +1,11 @@
+#pragma once
+
+#include <time.h>
+#include "types.c"
+
+// Monotonic wall-clock time in seconds, for timing runs outside of raylib.
+f64 Clock_Now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
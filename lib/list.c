@@ -10,8 +10,13 @@
           (slice)->data + (slice)->length++ \
         : (slice)->data + (slice)->length++)
 
+#define List_Reserve(slice, count, arena) \
+    while ((slice)->capacity < (count)) List_Grow(slice, sizeof(*(slice)->data), arena)
 
 
+// Doubles the capacity of `slice`. When its data is the last thing allocated
+// from `arena`, the arena is extended in place instead, so the old buffer is
+// not left behind.
 static void List_Grow(void *slice, ptrdiff_t size, Arena *arena) {
     struct {
         void     *data;
@@ -20,6 +25,14 @@ static void List_Grow(void *slice, ptrdiff_t size, Arena *arena) {
     } replica;
     memcpy(&replica, slice, sizeof(replica));
 
+    if (replica.capacity && replica.data + size*replica.capacity == arena->start
+            && arena->end - arena->start >= size*replica.capacity) {
+        Arena_AllocAlign(arena, size, 1, replica.capacity, 0);
+        replica.capacity *= 2;
+        memcpy(slice, &replica, sizeof(replica));
+        return;
+    }
+
     replica.capacity = replica.capacity ? replica.capacity : 1;
     ptrdiff_t align = 16;
     void *data = Arena_AllocAlign(arena, 2*size, align, replica.capacity, 0);
@@ -29,4 +42,3 @@ static void List_Grow(void *slice, ptrdiff_t size, Arena *arena) {
     replica.data = data;
     memcpy(slice, &replica, sizeof(replica));
 }
-
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "types.c"
+
+// A whole file mapped into memory. The mapping is private, so it can be
+// written to like any other buffer, but the writes never reach the file.
+// Pages are only read in when first touched.
+typedef struct {
+    void *data;
+    usize size;
+} Mapping;
+
+bool Mapping_Open(Mapping *mapping, char *path) {
+    *mapping = (Mapping) { 0 };
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive on its own
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    *mapping = (Mapping) { .data = data, .size = info.st_size };
+    return true;
+}
+
+void Mapping_Close(Mapping *mapping) {
+    if (mapping->data) munmap(mapping->data, mapping->size);
+    *mapping = (Mapping) { 0 };
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string.h>
+
+#include "types.c"
+#include "arena.c"
+
+// Recycles variable-sized blocks on top of an arena. Sizes are rounded up to a
+// power of two and freed blocks wait on one free list per size, so memory
+// handed back by one owner is reused by the next instead of growing the arena.
+
+#define POOL_CLASSES 48
+
+typedef struct PoolBlock PoolBlock;
+
+struct PoolBlock {
+    PoolBlock *next;
+};
+
+typedef struct {
+    PoolBlock *free[POOL_CLASSES];
+} Pool;
+
+// Smallest class whose blocks hold `size` bytes; no class is under 16 bytes.
+static u32 Pool_Class(usize size) {
+    u32 class = 4;
+    while (((usize) 1 << class) < size) class++;
+    return class;
+}
+
+void *Pool_Alloc(Pool *pool, usize size, Arena *arena) {
+    u32 class = Pool_Class(size);
+    PoolBlock *block = pool->free[class];
+    if (!block) return Arena_AllocAlign(arena, (usize) 1 << class, 16, 1, 0);
+
+    pool->free[class] = block->next;
+    return memset(block, 0, (usize) 1 << class);
+}
+
+// `size` must be the size the block was allocated with.
+void Pool_Free(Pool *pool, void *data, usize size) {
+    if (!data) return;
+    PoolBlock *block = data;
+    u32 class = Pool_Class(size);
+    block->next = pool->free[class];
+    pool->free[class] = block;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "types.c"
+
+// PCG32 (https://www.pcg-random.org/): small, fast and good enough for
+// sampling, and seeded explicitly so runs are reproducible.
+
+typedef struct {
+    u64 state;
+} Random;
+
+u32 Random_U32(Random *random) {
+    u64 state = random->state;
+    random->state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    u32 xorshifted = ((state >> 18) ^ state) >> 27;
+    u32 rotation = state >> 59;
+    return (xorshifted >> rotation) | (xorshifted << (-rotation & 31));
+}
+
+Random Random_New(u64 seed) {
+    Random random = { .state = seed + 1442695040888963407ULL };
+    Random_U32(&random);
+    return random;
+}
+
+// Uniform in [0, 1).
+f32 Random_F32(Random *random) {
+    return (Random_U32(random) >> 8) * 0x1.0p-24f;
+}
@@ -2,5 +2,5 @@
 
 #define Ray RAYLIB_Ray
 #include <raylib.h>
+#include <rlgl.h>
 #undef Ray
-
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "types.c"
+#include "arena.c"
+#include "list.c"
+
+// Generational handles for objects that live in a dense list. A handle names a
+// slot, the slot knows where its object currently sits in the list, and the
+// slot's generation changes whenever it is freed, so a handle to a removed
+// object reads as stale instead of naming whatever took its place. The map
+// only tracks positions: the owner pushes and swap-removes the objects itself,
+// in step with SlotMap_Insert and SlotMap_Remove.
+
+// The zero handle never names anything.
+typedef struct {
+    u32 index;
+    u32 generation;
+} Handle;
+
+// While in use `dense` is the object's position in the list; while free it is
+// the next free slot.
+typedef struct {
+    u32 dense;
+    u32 generation;
+} Slot;
+
+typedef struct {
+    Slot *data;
+    usize length;
+    usize capacity;
+} Slots;
+
+typedef struct {
+    u32 *data;
+    usize length;
+    usize capacity;
+} SlotOwners;
+
+typedef struct {
+    Slots slots;
+    // the slot of each object in the list
+    SlotOwners owners;
+    // first free slot plus one, or 0 when there is none
+    u32 free;
+} SlotMap;
+
+bool Handle_Equals(Handle a, Handle b) {
+    return a.index == b.index && a.generation == b.generation;
+}
+
+// Registers the object just pushed onto the end of the list.
+Handle SlotMap_Insert(SlotMap *map, Arena *arena) {
+    u32 index;
+    if (map->free) {
+        index = map->free - 1;
+        map->free = map->slots.data[index].dense;
+    } else {
+        index = map->slots.length;
+        // generations start at 1 so that the zero handle stays invalid
+        *List_Push(&map->slots, arena) = (Slot) { .generation = 1 };
+    }
+
+    Slot *slot = map->slots.data + index;
+    slot->dense = map->owners.length;
+    *List_Push(&map->owners, arena) = index;
+    return (Handle) { .index = index, .generation = slot->generation };
+}
+
+// Looks up where the object named by `handle` is in the list.
+bool SlotMap_Find(SlotMap *map, Handle handle, usize *dense) {
+    if (handle.index >= map->slots.length) return false;
+    Slot *slot = map->slots.data + handle.index;
+    if (slot->generation != handle.generation) return false;
+
+    *dense = slot->dense;
+    return true;
+}
+
+// Handle of the object at `dense` in the list.
+Handle SlotMap_Handle(SlotMap *map, usize dense) {
+    if (dense >= map->owners.length) { raise(SIGTRAP); }
+    u32 index = map->owners.data[dense];
+    return (Handle) { .index = index, .generation = map->slots.data[index].generation };
+}
+
+// Frees the slot of `handle`, returning where its object was in the list. The
+// owner must then move its last object into that position.
+bool SlotMap_Remove(SlotMap *map, Handle handle, usize *dense) {
+    if (!SlotMap_Find(map, handle, dense)) return false;
+
+    u32 last = map->owners.data[--map->owners.length];
+    map->owners.data[*dense] = last;
+    map->slots.data[last].dense = *dense;
+
+    Slot *slot = map->slots.data + handle.index;
+    if (++slot->generation == 0) slot->generation = 1;
+    slot->dense = map->free;
+    map->free = handle.index + 1;
+    return true;
+}
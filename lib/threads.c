@@ -0,0 +1,140 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "types.c"
+#include "arena.c"
+
+// Persistent pool of worker threads that run a batch of numbered tasks. Each
+// worker starts on its own contiguous range of tasks and, once that is empty,
+// steals from the front of the other workers' ranges, so uneven tasks still
+// keep every thread busy. The calling thread takes part as worker 0.
+
+typedef void (*ThreadTask)(void *context, usize task, usize worker);
+
+// Owner and thieves both claim tasks with an atomic increment of `next`, so a
+// task is never handed out twice. Padded to its own cache line.
+typedef struct {
+    usize next;
+    usize end;
+    u8 padding[64 - 2 * sizeof(usize)];
+} ThreadQueue;
+
+typedef struct ThreadPool ThreadPool;
+
+typedef struct {
+    ThreadPool *pool;
+    usize index;
+} ThreadWorker;
+
+struct ThreadPool {
+    usize count;
+    pthread_t *threads;
+    ThreadWorker *workers;
+    ThreadQueue *queues;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    usize generation;
+    usize running;
+    bool quit;
+
+    ThreadTask task;
+    void *context;
+};
+
+usize Threads_Count() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (usize) count : 1;
+}
+
+static void ThreadPool_Drain(ThreadPool *pool, usize worker) {
+    for (usize i = 0; i < pool->count; i++) {
+        ThreadQueue *queue = pool->queues + (worker + i) % pool->count;
+        for (;;) {
+            usize task = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+            if (task >= queue->end) break;
+            pool->task(pool->context, task, worker);
+        }
+    }
+}
+
+static void *ThreadPool_Work(void *argument) {
+    ThreadWorker *worker = argument;
+    ThreadPool *pool = worker->pool;
+    usize generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (pool->generation == generation && !pool->quit) {
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        }
+        if (pool->quit) break;
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        ThreadPool_Drain(pool, worker->index);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->running == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+// Starts `count - 1` threads; the pool must stay at the same address until
+// ThreadPool_Free. If a thread fails to start, the pool makes do with the
+// ones that did, so check `count` afterwards rather than assuming it.
+void ThreadPool_Init(ThreadPool *pool, usize count, Arena *arena) {
+    *pool = (ThreadPool) { .count = count ? count : 1 };
+    pool->threads = Arena_Alloc(arena, pthread_t, pool->count);
+    pool->workers = Arena_Alloc(arena, ThreadWorker, pool->count);
+    pool->queues = Arena_AllocAlign(arena, sizeof(ThreadQueue), 64, pool->count, 0);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (usize i = 0; i < pool->count; i++) {
+        pool->workers[i] = (ThreadWorker) { .pool = pool, .index = i };
+        if (i > 0 && pthread_create(pool->threads + i, NULL, ThreadPool_Work, pool->workers + i) != 0) {
+            pool->count = i;
+            break;
+        }
+    }
+}
+
+// Runs `task` for every task in [0, task_count) and waits for all of them.
+void ThreadPool_Run(ThreadPool *pool, usize task_count, ThreadTask task, void *context) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->context = context;
+    for (usize i = 0; i < pool->count; i++) {
+        pool->queues[i].next = task_count * i / pool->count;
+        pool->queues[i].end = task_count * (i + 1) / pool->count;
+    }
+    pool->running = pool->count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    ThreadPool_Drain(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->running > 0) pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void ThreadPool_Free(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (usize i = 1; i < pool->count; i++) pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+}
@@ -6,7 +6,7 @@
 #include "types.c"
 
 f32 Vector2_Length(Vector2 *v) {
-    return sqrt(pow(v->x, 2) + pow(v->y, 2));
+    return sqrtf(v->x * v->x + v->y * v->y);
 }
 
 f32 Vector2_Angle(Vector2 *v) {
@@ -43,3 +43,8 @@ f32 Vector2_Cross(Vector2 *a, Vector2 *b) {
     return a->x * b->y - a->y * b->x;
 }
 
+Vector2 Vector2_Normalize(Vector2 *v) {
+    f32 length = Vector2_Length(v);
+    return length > 0 ? Vector2_Scale(v, 1.0 / length) : *v;
+}
+
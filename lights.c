@@ -3,8 +3,12 @@
 #include "lib/types.c"
 #include "lib/arena.c"
 #include "lib/list.c"
+#include "lib/vectors.c"
 #include "lines.c"
 
+// Sources only remember which slots of the scene's `light_rays` they own; the
+// rays themselves are added and removed through scene.c.
+
 typedef struct {
     Vector2 position;
     usize *ray_indices;
@@ -21,23 +25,6 @@ PointLight *PointLights_Get(PointLights *point_lights, usize index) {
     return point_lights->data + index;
 }
 
-void PointLights_Add(PointLights *point_lights, Rays *light_rays, Vector2 *position, Arena *arena) {
-    // TODO: way to do this without global arena? in case point light is deleted?
-    usize *ray_indices = Arena_Alloc(arena, usize, POINT_SOURCE_RAY_NUMBER);
-    for (usize i = 0; i < POINT_SOURCE_RAY_NUMBER; i++) {
-        ray_indices[i] = light_rays->length;
-        *List_Push(light_rays, arena) = (Ray) {
-            .start = *position,
-            .angle = 2 * PI * i / POINT_SOURCE_RAY_NUMBER
-        };
-    }
-
-    *List_Push(point_lights, arena) = (PointLight) {
-        .position = *position,
-        .ray_indices = ray_indices
-    };
-}
-
 void PointLight_Update(PointLight *point_light, Rays *light_rays, Vector2 *position) {
     point_light->position = *position;
     for (usize i = 0; i < POINT_SOURCE_RAY_NUMBER; i++) {
@@ -46,3 +33,46 @@ void PointLight_Update(PointLight *point_light, Rays *light_rays, Vector2 *posit
         light_ray->start = *position;
     }
 }
+
+// A line source emits rays perpendicular to `line`, to its right when going
+// from start to end.
+typedef struct {
+    Line line;
+    usize *ray_indices;
+    u32 ray_count;
+} LineLight;
+
+typedef struct {
+    LineLight *data;
+    usize length;
+    usize capacity;
+} LineLights;
+
+LineLight *LineLights_Get(LineLights *line_lights, usize index) {
+    if (index < 0 || index >= line_lights->length) { raise(SIGTRAP); }
+    return line_lights->data + index;
+}
+
+// Number of evenly spaced rays a line source gets in `light_rays`.
+u32 LineLight_RayNumber(LineLight *line_light) {
+    return (u32) (Vector2_Distance(&line_light->line.start, &line_light->line.end) / LINE_SOURCE_RAY_DISTANCE) + 1;
+}
+
+// The ray a line source emits `scalar` of the way along its line.
+Ray LineLight_RayAt(LineLight *line_light, f32 scalar) {
+    Line *line = &line_light->line;
+    Vector2 delta = Vector2_Subtract(&line->end, &line->start);
+    f32 theta = Vector2_Angle(&delta) - PI / 2;
+
+    Vector2 position = {
+        line->start.x + scalar * delta.x,
+        line->start.y + scalar * delta.y
+    };
+    return Ray_FromAngle(position, theta);
+}
+
+// The `index`th of the evenly spaced rays of a line source.
+Ray LineLight_Ray(LineLight *line_light, u32 index) {
+    u32 num_rays = LineLight_RayNumber(line_light);
+    return LineLight_RayAt(line_light, num_rays > 1 ? (f32) index / (num_rays - 1) : 0);
+}
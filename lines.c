@@ -3,15 +3,22 @@
 #include <float.h>
 #include <math.h>
 #include <signal.h>
+#include <stdbool.h>
 
 #include "lib/types.c"
 #include "lib/raylib.c"
 #include "lib/vectors.c"
 #include "constants.c"
 
+// `direction` is always a unit vector; `intensity` starts at 1 at the source
+// (or at the sample weight for progressive rays) and drops with every
+// interaction. `wavelength` is in nanometers, or 0 for a white ray carrying
+// the whole spectrum (see spectrum.c).
 typedef struct {
     Vector2 start;
-    f32 angle;
+    Vector2 direction;
+    f32 intensity;
+    f32 wavelength;
 } Ray;
 
 typedef struct {
@@ -41,8 +48,21 @@ Ray *Rays_Get(Rays *rays, usize index) {
     return rays->data + index;
 }
 
+// Angles are only for building rays from the UI; tracing never converts back.
+Ray Ray_FromAngle(Vector2 start, f32 angle) {
+    return (Ray) {
+        .start = start,
+        .direction = { cos(angle), sin(angle) },
+        .intensity = 1
+    };
+}
+
 Vector2 Ray_ToVector(Ray *ray) {
-    return (Vector2) { cos(ray->angle), sin(ray->angle) };
+    return ray->direction;
+}
+
+f32 Ray_Angle(Ray *ray) {
+    return Vector2_Angle(&ray->direction);
 }
 
 f32 Line_Angle(Line *line) {
@@ -50,6 +70,13 @@ f32 Line_Angle(Line *line) {
     return Vector2_Angle(&delta);
 }
 
+// Unit normal, a quarter turn counterclockwise from start to end.
+Vector2 Line_Normal(Line *line) {
+    Vector2 delta = Vector2_Subtract(&line->end, &line->start);
+    Vector2 normal = { delta.y, -delta.x };
+    return Vector2_Normalize(&normal);
+}
+
 // line segment = a + bt where a = start, b = end - start, 0 < t < 1
 // t_1 = (a_2 - a_1) X b_2 / (b_1 X b_2), t_2 = (a_2 - a_1) X b_1 / (b_1 X b_2)
 Vector2 lines_intersect(Line *line_1, Line *line_2) {
@@ -72,24 +99,28 @@ Vector2 lines_intersect(Line *line_1, Line *line_2) {
     return (Vector2) { NAN, NAN };
 }
 
-Vector2 ray_line_intersect(Ray *ray, Line *line) {
-    Vector2 a_1 = ray->start;
-    Vector2 a_2 = line->start;
-    Vector2 b_1 = Ray_ToVector(ray);
+// Distance along the unit vector `direction` from `start` to `line`, or
+// FLT_MAX if the ray misses it.
+f32 ray_line_distance(Vector2 *start, Vector2 *direction, Line *line) {
     Vector2 b_2 = Vector2_Subtract(&line->end, &line->start);
-
-    Vector2 separation = Vector2_Subtract(&a_2, &a_1);
-    f32 denominator = Vector2_Cross(&b_1, &b_2);
-    if (fabs(denominator) < EPSILON) return (Vector2) { NAN, NAN };
+    Vector2 separation = Vector2_Subtract(&line->start, start);
+    f32 denominator = Vector2_Cross(direction, &b_2);
+    if (fabs(denominator) < EPSILON) return FLT_MAX;
 
     // intersection when t_1 > 0 and 0 < t_2 < 1
     f32 t_1 = Vector2_Cross(&separation, &b_2) / denominator;
-    f32 t_2 = Vector2_Cross(&separation, &b_1) / denominator;
-    if (t_1 > EPSILON && t_2 > EPSILON && t_2 < 1.0 - EPSILON) {
-        return (Vector2) { a_1.x + b_1.x * t_1, a_1.y + b_1.y * t_1 };
-    }
+    f32 t_2 = Vector2_Cross(&separation, direction) / denominator;
+    if (t_1 > EPSILON && t_2 > EPSILON && t_2 < 1.0f - EPSILON) return t_1;
 
-    return (Vector2) { NAN, NAN };
+    return FLT_MAX;
+}
+
+Vector2 ray_line_intersect(Ray *ray, Line *line) {
+    Vector2 direction = Ray_ToVector(ray);
+    f32 t = ray_line_distance(&ray->start, &direction, line);
+    if (t == FLT_MAX) return (Vector2) { NAN, NAN };
+
+    return (Vector2) { ray->start.x + direction.x * t, ray->start.y + direction.y * t };
 }
 
 Vector2 rays_intersect(Ray *ray_1, Ray *ray_2) {
@@ -133,3 +164,50 @@ usize closest_intersection(Ray *ray, Lines *lines, Vector2 *intersection, f32 *d
     return index;
 }
 
+
+// Clips `line` in place to the box [min, max], by clipping the segment against
+// each slab in turn. Returns false if no part of it is inside.
+bool Line_Clip(Line *line, Vector2 *min, Vector2 *max) {
+    Vector2 delta = Vector2_Subtract(&line->end, &line->start);
+    f32 starts[2] = { line->start.x, line->start.y };
+    f32 deltas[2] = { delta.x, delta.y };
+    f32 mins[2] = { min->x, min->y };
+    f32 maxs[2] = { max->x, max->y };
+
+    f32 t_min = 0, t_max = 1;
+    for (i32 axis = 0; axis < 2; axis++) {
+        if (deltas[axis] == 0) {
+            if (starts[axis] < mins[axis] || starts[axis] > maxs[axis]) return false;
+            continue;
+        }
+
+        f32 t_1 = (mins[axis] - starts[axis]) / deltas[axis];
+        f32 t_2 = (maxs[axis] - starts[axis]) / deltas[axis];
+        t_min = fmaxf(t_min, fminf(t_1, t_2));
+        t_max = fminf(t_max, fmaxf(t_1, t_2));
+        if (t_min > t_max) return false;
+    }
+
+    Vector2 start = line->start;
+    line->start = (Vector2) { start.x + delta.x * t_min, start.y + delta.y * t_min };
+    line->end = (Vector2) { start.x + delta.x * t_max, start.y + delta.y * t_max };
+    return true;
+}
+
+// Whether any part of `line` lies inside the box [min, max].
+bool Line_IntersectsBox(Line *line, Vector2 *min, Vector2 *max) {
+    Line clipped = *line;
+    return Line_Clip(&clipped, min, max);
+}
+
+// Distance from `point` to the nearest point on `line`.
+f32 Line_Distance(Line *line, Vector2 *point) {
+    Vector2 delta = Vector2_Subtract(&line->end, &line->start);
+    Vector2 offset = Vector2_Subtract(point, &line->start);
+    f32 length_squared = Vector2_Dot(&delta, &delta);
+    f32 t = length_squared > 0 ? Vector2_Dot(&offset, &delta) / length_squared : 0;
+    t = fminf(1, fmaxf(0, t));
+
+    Vector2 closest = { line->start.x + t * delta.x, line->start.y + t * delta.y };
+    return Vector2_Distance(point, &closest);
+}
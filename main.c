@@ -3,9 +3,17 @@
 //////////////
 
 // 1. When a light source is created or changed, update `light_rays` array.
-// 2. When a component (like lenses or mirrors) is created or changed, iterate
-//    over `LightRays` and components to generate `light_lines` array.
-// 3. Iterate over `light_lines` to render final output.
+// 2. When a component (like lenses or mirrors) is created or changed, retrace
+//    the `light_rays` it affects to regenerate the `light_lines` array (see
+//    `TraceCache`).
+// 3. Iterate over `light_lines` to render final output, or splat them into an
+//    `Irradiance` map to show how much light reaches each pixel. In the
+//    progressive view, `Progressive` instead keeps adding randomly sampled
+//    rays from every source into the map while the scene stays still.
+//    `Refine` can first add rays between neighboring source rays whose paths
+//    part ways, to sharpen edges and focal regions.
+// 4. `Focus` pairs up the cached segments that cross in the same spot to find
+//    focal points and caustics, and circles them over the output.
 
 /////////////////////
 // MATH CONVENTION //
@@ -23,6 +31,10 @@
 // Transfer Matrix Analysis]
 // (https://en.wikipedia.org/wiki/Ray_transfer_matrix_analysis). The resulting
 // ray forms an angle ⍺' = β + θ_2 - π/2.
+//
+// The tracer itself never works with angles: rays carry unit direction vectors
+// and components cache their unit normals, so `reflect_mirror` and
+// `refract_lens` apply the same rules as vector operations.
 
 #include <float.h>
 #include <stdbool.h>
@@ -41,7 +53,19 @@
 #include "constants.c"
 #include "lines.c"
 #include "optics.c"
+#include "components.c"
 #include "lights.c"
+#include "scene.c"
+#include "scenefile.c"
+#include "trace.c"
+#include "cache.c"
+#include "renderer.c"
+#include "irradiance.c"
+#include "progressive.c"
+#include "refine.c"
+#include "focus.c"
+#include "export.c"
+#include "profile.c"
 #include "tests.c"
 
 typedef struct {
@@ -51,13 +75,31 @@ typedef struct {
     Vector2 line_source_start;
     Vector2 lens_start;
     Vector2 mirror_start;
+    f32 focal_length;
 } DrawState;
 
-void add_line_source(Rays*, DrawState*, Arena*);
-void add_mirror(Lines*, DrawState*, Arena*);
-void add_lens(Lenses*, DrawState*, Arena*);
-
-i32 main() {
+// What the mouse last clicked on; dragging moves it.
+typedef struct {
+    SceneObject object;
+    Vector2 mouse;
+} EditState;
+
+typedef enum {
+    VIEW_LINES,
+    VIEW_IRRADIANCE,
+    VIEW_PROGRESSIVE,
+    VIEW_COUNT
+} View;
+
+void add_line_source(Scene*, DrawState*);
+void add_mirror(Scene*, DrawState*);
+void add_lens(Scene*, DrawState*);
+void edit_scene(Scene*, EditState*, DrawState*);
+void draw_selection(Scene*, EditState*);
+void draw_focus(Focus*, TraceCache*, Font);
+
+// usage: ./build/main [scene file]
+i32 main(i32 argc, char **argv) {
     printf("hi\n");
 
     Arena arena = Arena_New(1024 * 1014);
@@ -69,172 +111,329 @@ i32 main() {
     DrawState draw_state = (DrawState) {
         .drawing_line_source = false,
         .drawing_mirror = false,
-        .drawing_lens = false
+        .drawing_lens = false,
+        .focal_length = LENS_FOCAL_LENGTH
     };
-
-    Rays light_rays = { 0 };
-    Lines light_lines = { 0 };
-    Lines mirrors = { 0 };
-    Lenses lenses = { 0 };
-    PointLights point_lights = { 0 };
-
-    test_update_setup(&light_rays, &point_lights, &lenses, &arena);
+    EditState edit_state = { 0 };
+
+    // `light_lines` is rebuilt every frame in `frame`, which is then reset
+    Arena frame = { 0 };
+    Scene scene = Scene_New();
+    LightLines light_lines = { 0 };
+    Tracer tracer;
+    Tracer_Init(&tracer, Threads_Count(), &arena);
+    TraceCache cache = { 0 };
+    LineRenderer renderer = { 0 };
+
+    // [5] cycles between drawing the light lines, their irradiance map and the
+    // progressive irradiance map
+    View view = VIEW_LINES;
+    Progressive progressive;
+    Progressive_Init(&progressive, PROGRESSIVE_RAY_BUDGET, time(NULL));
+    Irradiance irradiance;
+    Irradiance_Init(&irradiance, WIDTH, HEIGHT, &tracer.pool, &arena);
+    Image irradiance_image = GenImageColor(WIDTH, HEIGHT, BLACK);
+    Texture2D irradiance_texture = LoadTextureFromImage(irradiance_image);
+    UnloadImage(irradiance_image);
+
+    // [R] toggles adding rays between source rays whose paths part ways; the
+    // refined lines are then drawn and splatted instead of the cached ones
+    Refine refine;
+    Refine_Init(&refine, REFINE_RAY_BUDGET);
+    bool refining = false;
+
+    // [F] toggles finding where rays converge: focal points are circled at
+    // their spot size and listed on stdout, and the rays of the brightest are
+    // drawn over
+    Focus focus;
+    Focus_Init(&focus, &tracer.pool, &arena);
+    bool focusing = false;
+
+    // [E] starts and stops streaming every traced frame to TRACE_EXPORT_PATH
+    TraceExport export;
+    bool exporting = false;
+
+    // [P] toggles timing every frame and its overlay, [O] dumps the recorded
+    // frames to PROFILE_DUMP_PATH
+    Profiler profiler = { 0 };
+
+    if (argc > 1) {
+        if (!Scene_Load(&scene, argv[1])) printf("could not load %s\n", argv[1]);
+    } else {
+        test_update_setup(&scene);
+    }
 
     while (!WindowShouldClose()) {
+        Profiler_Begin(&profiler, PROFILE_FRAME);
+        Profiler_Begin(&profiler, PROFILE_INPUT);
         Vector2 mouse = GetMousePosition();
+        Arena_Reset(&frame);
+        light_lines = (LightLines) { 0 };
 
         // add_point_source(&light_rays, &arena);
-        if (IsKeyPressed(KEY_ONE)) PointLights_Add(&point_lights, &light_rays, &mouse, &arena);
-        add_line_source(&light_rays, &draw_state, &arena);
-        add_mirror(&mirrors, &draw_state, &arena);
-        add_lens(&lenses, &draw_state, &arena);
-
-        test_update_main(&light_rays, &point_lights);
-
-        // generate `light_lines` every frame based on components
-        for (i32 i = 0; i < light_rays.length; i++) {
-            Ray *ray = Rays_Get(&light_rays, i);
-
-            Vector2 mirror_intersection, lens_intersection;
-            f32 mirror_distance, lens_distance;
-            usize mirror_index = closest_intersection(ray, &mirrors, &mirror_intersection, &mirror_distance);
-            usize lens_index = closest_lens(ray, &lenses, &lens_intersection, &lens_distance);
-
-            while (mirror_index != (usize) -1 || lens_index != (usize) -1) {
-                // IDEA: take minimum of components, use result to pick intersection and refraction function
-                if (mirror_distance < lens_distance) {
-                    *List_Push(&light_lines, &arena) = (Line) {
-                        .start = ray->start,
-                        .end = mirror_intersection
-                    };
-
-                    Line *mirror = Lines_Get(&mirrors, mirror_index);
-                    ray = &(Ray) {
-                        .angle = reflect_mirror(ray, mirror),
-                        .start = mirror_intersection
-                    };
-
-                    mirror_index = closest_intersection(ray, &mirrors, &mirror_intersection, &mirror_distance);
-                    lens_index = closest_lens(ray, &lenses, &lens_intersection, &lens_distance);
-                }
-
-                if (lens_distance < mirror_distance) {
-                    *List_Push(&light_lines, &arena) = (Line) {
-                        .start = ray->start,
-                        .end = lens_intersection
-                    };
-
-                    Lens *lens = Lenses_Get(&lenses, lens_index);
-                    ray = &(Ray) {
-                        .angle = refract_lens(ray, lens),
-                        .start = lens_intersection
-                    };
-
-                    mirror_index = closest_intersection(ray, &mirrors, &mirror_intersection, &mirror_distance);
-                    lens_index = closest_lens(ray, &lenses, &lens_intersection, &lens_distance);
-                }
-            }
-
-            // add in the rest of the ray
-            Vector2 light_vector = Ray_ToVector(ray);
-            Vector2 scaled_vector = Vector2_Scale(&light_vector, LIGHT_RAY_LENGTH);
-            *List_Push(&light_lines, &arena) = (Line) {
-                .start = ray->start,
-                .end = Vector2_Add(&ray->start, &scaled_vector)
-            };
+        if (IsKeyPressed(KEY_ONE)) Scene_AddPointLight(&scene, &mouse);
+        add_line_source(&scene, &draw_state);
+        add_mirror(&scene, &draw_state);
+        add_lens(&scene, &draw_state);
+        edit_scene(&scene, &edit_state, &draw_state);
+        if (IsKeyPressed(KEY_S)) {
+            bool saved = Scene_Save(&scene, SCENE_SAVE_PATH, &frame);
+            printf(saved ? "saved %s\n" : "could not save %s\n", SCENE_SAVE_PATH);
+        }
+        bool view_changed = IsKeyPressed(KEY_FIVE);
+        if (view_changed) {
+            view = (view + 1) % VIEW_COUNT;
+            // the irradiance view reuses the map, so always start over
+            Progressive_Restart(&progressive, &irradiance);
         }
 
-        // draw all `light_lines` and components
-        BeginDrawing();
-        ClearBackground(BLACK);
-
-        for (i32 i = 0; i < light_lines.length; i++) {
-            Line *line = Lines_Get(&light_lines, i);
-            DrawLine(line->start.x, line->start.y, line->end.x, line->end.y, WHITE);
+        if (IsKeyPressed(KEY_A)) scene.accelerator = (scene.accelerator + 1) % ACCELERATOR_COUNT;
+        if (IsKeyPressed(KEY_M)) Scene_SetParaxial(&scene, !scene.paraxial.enabled);
+        if (IsKeyPressed(KEY_P)) Profiler_Toggle(&profiler);
+        if (IsKeyPressed(KEY_O)) {
+            bool dumped = Profiler_Dump(&profiler, PROFILE_DUMP_PATH);
+            printf(dumped ? "dumped %s\n" : "could not dump %s\n", PROFILE_DUMP_PATH);
         }
 
-        for (i32 i = 0; i < mirrors.length; i++) {
-            Line *line = Lines_Get(&mirrors, i);
-            DrawLine(line->start.x, line->start.y, line->end.x, line->end.y, GRAY);
+        test_update_main(&scene);
+        Profiler_End(&profiler, PROFILE_INPUT);
+
+        // regenerate `light_lines` for the rays touched by what changed
+        Profiler_Begin(&profiler, PROFILE_TRACE);
+        usize retraced = TraceCache_Update(&cache, &tracer, &scene, &light_lines, &frame);
+        Profiler_Count(&profiler, PROFILE_RAYS, cache.stats.rays);
+        Profiler_Count(&profiler, PROFILE_BOUNCES, cache.stats.bounces);
+        Profiler_Count(&profiler, PROFILE_TESTS, cache.stats.intersection_tests);
+        Profiler_Count(&profiler, PROFILE_SEGMENTS, cache.stats.segments);
+        bool refine_toggled = IsKeyPressed(KEY_R);
+        if (refine_toggled) refining = !refining;
+        if (refining && (retraced > 0 || refine_toggled)) {
+            Refine_Run(&refine, &tracer, &scene, &cache);
+            Profiler_Count(&profiler, PROFILE_RAYS, refine.stats.rays);
+            Profiler_Count(&profiler, PROFILE_BOUNCES, refine.stats.bounces);
+            Profiler_Count(&profiler, PROFILE_TESTS, refine.stats.intersection_tests);
+            Profiler_Count(&profiler, PROFILE_SEGMENTS, refine.stats.segments);
         }
+        if (refining) light_lines = refine.light_lines;
+        Profiler_End(&profiler, PROFILE_TRACE);
+        bool focus_toggled = IsKeyPressed(KEY_F);
+        if (focus_toggled) focusing = !focusing;
+        if (focusing && (retraced > 0 || focus_toggled)) {
+            Focus_Begin(&focus);
+            Focus_AddCache(&focus, &scene, &cache);
+            Focus_Run(&focus);
+            if (focus_toggled) Focus_Print(&focus, stdout);
+        }
+        if (IsKeyPressed(KEY_E)) {
+            if (exporting) {
+                if (!TraceExport_Close(&export)) printf("could not write %s\n", TRACE_EXPORT_PATH);
+                exporting = false;
+            } else {
+                exporting = TraceExport_Open(&export, TRACE_EXPORT_PATH);
+                if (!exporting) printf("could not create %s\n", TRACE_EXPORT_PATH);
+            }
+        }
+        if (exporting) {
+            for (usize i = 0; i < cache.paths.length; i++) {
+                LightLines *path = &cache.paths.data[i].path;
+                TraceExport_AddRay(&export, i, path->data, path->length);
+            }
+            TraceExport_EndFrame(&export);
+        }
+        Profiler_Begin(&profiler, PROFILE_IRRADIANCE);
+        if (view == VIEW_IRRADIANCE && (retraced > 0 || view_changed || refine_toggled)) {
+            Irradiance_Clear(&irradiance);
+            Irradiance_Splat(&irradiance, &light_lines);
+            Irradiance_ToneMap(&irradiance, IRRADIANCE_EXPOSURE);
+            UpdateTexture(irradiance_texture, irradiance.colors);
+        }
+        if (view == VIEW_PROGRESSIVE) {
+            TraceStats before = progressive.stats;
+            Progressive_Step(&progressive, &tracer, &scene, &irradiance);
+            Progressive_ToneMap(&progressive, &irradiance, IRRADIANCE_EXPOSURE);
+            UpdateTexture(irradiance_texture, irradiance.colors);
+            // Progressive_Step restarts the stats when the scene changes
+            if (progressive.passes == 1) before = (TraceStats) { 0 };
+            Profiler_Count(&profiler, PROFILE_RAYS, progressive.stats.rays - before.rays);
+            Profiler_Count(&profiler, PROFILE_BOUNCES, progressive.stats.bounces - before.bounces);
+            Profiler_Count(&profiler, PROFILE_TESTS, progressive.stats.intersection_tests - before.intersection_tests);
+            Profiler_Count(&profiler, PROFILE_SEGMENTS, progressive.stats.segments - before.segments);
+        }
+        Profiler_End(&profiler, PROFILE_IRRADIANCE);
+
+        // draw all `light_lines` (or the irradiance map) and components
+        Profiler_Begin(&profiler, PROFILE_DRAW);
+        BeginDrawing();
+        ClearBackground(BLACK);
 
-        for (i32 i = 0; i < lenses.length; i++) {
-            Line line = Lenses_Get(&lenses, i)->line;
-            DrawLine(line.start.x, line.start.y, line.end.x, line.end.y, BLUE);
+        if (view != VIEW_LINES) {
+            DrawTexture(irradiance_texture, 0, 0, WHITE);
+            LineRenderer_Draw(&renderer, &(LightLines) { 0 }, &scene.components);
+        } else {
+            LineRenderer_Draw(&renderer, &light_lines, &scene.components);
         }
+        draw_selection(&scene, &edit_state);
+        if (focusing) draw_focus(&focus, &cache, font);
+        Profiler_End(&profiler, PROFILE_DRAW);
 
+        Profiler_Begin(&profiler, PROFILE_TEXT);
         DrawTextEx(font, "[1] Add point source", (Vector2) { 4, 4 }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
         DrawTextEx(font, "[2] Add line source", (Vector2) { 4, 4 + 1.2 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
         DrawTextEx(font,"[3] Add mirror", (Vector2) { 4, 4 + 2.4 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
         DrawTextEx(font, "[4] Add ideal lens", (Vector2) { 4, 4 + 3.6 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
-
+        DrawTextEx(font, "[5] Switch view", (Vector2) { 4, 4 + 4.8 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
+        DrawTextEx(font, "[Click] Select, drag to move", (Vector2) { 4, 4 + 6.0 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
+        DrawTextEx(font, "[Delete] Remove selection", (Vector2) { 4, 4 + 7.2 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
+        DrawTextEx(font, TextFormat("[Up/Down] Focal length: %.0f", draw_state.focal_length), (Vector2) { 4, 4 + 8.4 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
+        DrawTextEx(font, "[S] Save scene", (Vector2) { 4, 4 + 9.6 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
+        DrawTextEx(font, exporting ? "[E] Stop recording" : "[E] Record trace", (Vector2) { 4, 4 + 10.8 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, exporting ? RED : LIGHTGRAY);
+        DrawTextEx(font, profiler.enabled ? "[P] Hide profiler, [O] Dump" : "[P] Show profiler", (Vector2) { 4, 4 + 12.0 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
+        DrawTextEx(font, TextFormat("[A] Accelerator: %s", ACCELERATOR_NAMES[scene.accelerator]), (Vector2) { 4, 4 + 13.2 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
+        DrawTextEx(font, "[D] Toggle lens dispersion", (Vector2) { 4, 4 + 14.4 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
+        DrawTextEx(font, TextFormat("[M] Lens runs by matrix: %s", scene.paraxial.enabled ? "on" : "off"), (Vector2) { 4, 4 + 15.6 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
+        DrawTextEx(font, refining ? TextFormat("[R] Refine sources: %zu rays added", refine.added) : "[R] Refine sources", (Vector2) { 4, 4 + 16.8 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
+        DrawTextEx(font, focusing ? TextFormat("[F] Focal points: %zu", focus.points.length) : "[F] Find focal points", (Vector2) { 4, 4 + 18.0 * TEXT_HEIGHT }, TEXT_HEIGHT, TEXT_SPACING, LIGHTGRAY);
+        Profiler_Draw(&profiler, font, (Vector2) { PROFILE_OVERLAY_X, 4 });
+        Profiler_End(&profiler, PROFILE_TEXT);
+
+        Profiler_Begin(&profiler, PROFILE_PRESENT);
         EndDrawing();
+        Profiler_End(&profiler, PROFILE_PRESENT);
 
-        // TODO: persistent `light_lines` array?
-        light_lines.length = 0;
+        Profiler_Count(&profiler, PROFILE_ARENA_BYTES, Arena_Used(&frame) + Arena_Used(&scene.arena) + Arena_Used(&cache.arena));
+        Profiler_End(&profiler, PROFILE_FRAME);
+        Profiler_EndFrame(&profiler);
     }
 
+    if (exporting) TraceExport_Close(&export);
+    UnloadTexture(irradiance_texture);
+    Irradiance_Free(&irradiance);
+    Progressive_Free(&progressive);
+    Refine_Free(&refine);
+    Focus_Free(&focus);
+    LineRenderer_Free(&renderer);
+    TraceCache_Free(&cache);
+    Tracer_Free(&tracer);
+    Scene_Free(&scene);
+    Arena_Free(&frame);
     Arena_Free(&arena);
     CloseWindow();
     return 0;
 }
 
-void add_line_source(Rays *light_rays, DrawState *state, Arena *arena) {
+void add_line_source(Scene *scene, DrawState *state) {
     if (!IsKeyPressed(KEY_TWO)) return;
     if (!state->drawing_line_source) {
         state->line_source_start = GetMousePosition();
     } else {
-        Vector2 start = state->line_source_start;
-        Vector2 end = GetMousePosition();
-        Vector2 delta = Vector2_Subtract(&end, &start);
-
-        u32 num_rays = (u32) (Vector2_Length(&delta) / LINE_SOURCE_RAY_DISTANCE);
-        f32 theta = Vector2_Angle(&delta) - PI / 2;
-
-        for (i32 i = 0; i <= num_rays; i++) {
-            f32 scalar = (float) i / num_rays;
-            *List_Push(light_rays, arena) = (Ray) {
-                .start = {
-                    start.x + scalar * delta.x,
-                    start.y + scalar * delta.y
-                },
-                .angle = theta
-            };
-        }
+        Line line = { .start = state->line_source_start, .end = GetMousePosition() };
+        Scene_AddLineLight(scene, &line);
     }
 
     state->drawing_line_source = !state->drawing_line_source;
 }
 
-void add_mirror(Lines *mirrors, DrawState *state, Arena *arena) {
+void add_mirror(Scene *scene, DrawState *state) {
     if (!IsKeyPressed(KEY_THREE)) return;
     if (!state->drawing_mirror) {
         state->mirror_start = GetMousePosition();
     } else {
-        *List_Push(mirrors, arena) = (Line) {
+        Scene_AddMirror(scene, &(Line) {
             .start = state->mirror_start,
             .end = GetMousePosition()
-        };
+        });
     }
 
     state->drawing_mirror = !state->drawing_mirror;
 }
 
-// TODO: make focal length adjustable
-void add_lens(Lenses *lenses, DrawState *state, Arena *arena) {
+void add_lens(Scene *scene, DrawState *state) {
     if (!IsKeyPressed(KEY_FOUR)) return;
     if (!state->drawing_lens) {
         state->lens_start = GetMousePosition();
     } else {
-        *List_Push(lenses, arena) = (Lens) {
-            .line = {
-                .start = state->lens_start,
-                .end = GetMousePosition()
-            },
-            .focal_length = 300.0
-        };
+        Scene_AddLens(scene, &(Line) {
+            .start = state->lens_start,
+            .end = GetMousePosition()
+        }, state->focal_length);
     }
 
     state->drawing_lens = !state->drawing_lens;
 }
 
+// Selects, drags and removes sources and components. [Up] and [Down] change
+// the focal length of the selected lens, or of new lenses if none is selected.
+// [D] turns dispersion on or off for the selected lens.
+void edit_scene(Scene *scene, EditState *state, DrawState *draw_state) {
+    Vector2 mouse = GetMousePosition();
+    if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+        state->object = Scene_Pick(scene, &mouse, PICK_RADIUS);
+    } else if (IsMouseButtonDown(MOUSE_BUTTON_LEFT) && state->object.kind != SCENE_NONE) {
+        Vector2 delta = Vector2_Subtract(&mouse, &state->mouse);
+        if (delta.x != 0 || delta.y != 0) Scene_Translate(scene, &state->object, &delta);
+    }
+    state->mouse = mouse;
+
+    if (IsKeyPressed(KEY_DELETE) || IsKeyPressed(KEY_BACKSPACE)) {
+        Scene_Remove(scene, &state->object);
+        state->object = (SceneObject) { .kind = SCENE_NONE };
+    }
+
+    Component *selected = state->object.kind == SCENE_COMPONENT ? Scene_GetComponent(scene, state->object.handle) : NULL;
+    if (IsKeyPressed(KEY_D) && selected) {
+        Scene_SetDispersion(scene, state->object.handle, selected->dispersion == 0 ? LENS_DISPERSION : 0);
+    }
+
+    f32 scale = IsKeyPressed(KEY_UP) ? FOCAL_LENGTH_STEP : IsKeyPressed(KEY_DOWN) ? 1 / FOCAL_LENGTH_STEP : 1;
+    if (scale == 1) return;
+    if (selected && selected->kind == COMPONENT_LENS) {
+        Scene_SetFocalLength(scene, state->object.handle, selected->focal_length * scale);
+        draw_state->focal_length = selected->focal_length;
+    } else {
+        draw_state->focal_length *= scale;
+    }
+}
+
+void draw_selection(Scene *scene, EditState *state) {
+    switch (state->object.kind) {
+        case SCENE_POINT_LIGHT: {
+            PointLight *point_light = Scene_GetPointLight(scene, state->object.handle);
+            if (point_light) DrawCircleLinesV(point_light->position, PICK_RADIUS, YELLOW);
+            break;
+        }
+        case SCENE_LINE_LIGHT: {
+            LineLight *line_light = Scene_GetLineLight(scene, state->object.handle);
+            if (line_light) DrawLineV(line_light->line.start, line_light->line.end, YELLOW);
+            break;
+        }
+        case SCENE_COMPONENT: {
+            Component *component = Scene_GetComponent(scene, state->object.handle);
+            if (component) DrawLineV(component->line.start, component->line.end, YELLOW);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Circles every focal point at its spot size, labels the brightest and draws
+// the rays that cross at the brightest of all.
+void draw_focus(Focus *focus, TraceCache *cache, Font font) {
+    if (focus->points.length > 0) {
+        FocalPoint *brightest = focus->points.data;
+        for (u32 i = 0; i < brightest->ray_count; i++) {
+            LightLines *path = &cache->paths.data[focus->rays.data[brightest->first_ray + i]].path;
+            for (usize k = 0; k < path->length; k++) {
+                DrawLineV(path->data[k].line.start, path->data[k].line.end, ColorAlpha(GOLD, 0.3));
+            }
+        }
+    }
+
+    for (usize i = 0; i < focus->points.length; i++) {
+        FocalPoint *point = focus->points.data + i;
+        DrawCircleLinesV(point->point, fmaxf(point->spot, FOCUS_MARK_RADIUS), GOLD);
+        if (i >= FOCUS_LABELS) continue;
+        Vector2 position = { point->point.x + FOCUS_MARK_RADIUS, point->point.y + FOCUS_MARK_RADIUS };
+        DrawTextEx(font, TextFormat("spot %.2f, %u rays", point->spot, point->ray_count), position, TEXT_HEIGHT, TEXT_SPACING, GOLD);
+    }
+}
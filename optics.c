@@ -40,28 +40,34 @@ usize closest_lens(Ray *ray, Lenses *lenses, Vector2 *intersection, f32 *distanc
     return index;
 }
 
-// TODO: maybe make functions more general to any optical device?
-f32 reflect_mirror(Ray *light_ray, Line *mirror) {
-    f32 alpha = light_ray->angle;
-    f32 beta = Line_Angle(mirror);
-
-    f32 theta_1 = alpha - beta + PI/2;
-    f32 theta_2 = PI - theta_1;
-    return theta_2 + beta - PI/2;
+// Mirror reflection: d' = d - 2 (d . n) n.
+Vector2 reflect_mirror(Ray *light_ray, Vector2 *normal) {
+    f32 projection = 2 * Vector2_Dot(&light_ray->direction, normal);
+    Vector2 reflected = Vector2_Scale(normal, projection);
+    return Vector2_Subtract(&light_ray->direction, &reflected);
 }
 
-f32 refract_lens(Ray *light_ray, Lens *lens) {
-    f32 alpha = light_ray->angle;
-    f32 beta = Line_Angle(&lens->line);
-
-    Vector2 intersection = ray_line_intersect(light_ray, &lens->line);
-    Vector2 center = Vector2_Average(&lens->line.start, &lens->line.end);
-    Vector2 displacement = Vector2_Subtract(&center, &intersection);
-    Vector2 light_vector = Ray_ToVector(light_ray);
-    f32 x_1 = Vector2_Cross(&displacement, &light_vector);
-
-    f32 theta_1 = alpha - beta + PI/2;
-    f32 theta_2 = -x_1 / lens->focal_length + theta_1;
-    return theta_2 + beta - PI/2;
+// Focal length at `wavelength` of a lens with focal length `focal_length` at
+// the helium d line. Lensmaker's equation makes the power 1 / f proportional
+// to n - 1, and a Cauchy model n = A + B / wavelength^2 with `dispersion` as
+// the inverse Abbe number (n_F - n_C) / (n_d - 1) fixes how that varies. White
+// rays (wavelength 0) see `focal_length`.
+f32 dispersed_focal_length(f32 focal_length, f32 dispersion, f32 wavelength) {
+    if (wavelength == 0 || dispersion == 0) return focal_length;
+    f32 d = 1 / (WAVELENGTH_D * WAVELENGTH_D);
+    f32 f = 1 / (WAVELENGTH_F * WAVELENGTH_F);
+    f32 c = 1 / (WAVELENGTH_C * WAVELENGTH_C);
+    f32 power = 1 + dispersion * (1 / (wavelength * wavelength) - d) / (f - c);
+    return focal_length / power;
 }
 
+// Ideal thin lens. Writing the ray as a slope m relative to the lens axis at a
+// height y from the center, the lens maps m' = m - y / f. In vector form that
+// is d' = d + |d . n| (center - intersection) / f, normalized.
+Vector2 refract_lens(Ray *light_ray, Vector2 *normal, Vector2 *center, Vector2 *intersection, f32 focal_length) {
+    Vector2 displacement = Vector2_Subtract(center, intersection);
+    f32 scale = fabsf(Vector2_Dot(&light_ray->direction, normal)) / focal_length;
+    Vector2 deflection = Vector2_Scale(&displacement, scale);
+    Vector2 refracted = Vector2_Add(&light_ray->direction, &deflection);
+    return Vector2_Normalize(&refracted);
+}
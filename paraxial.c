@@ -0,0 +1,391 @@
+#pragma once
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/vectors.c"
+#include "constants.c"
+#include "lines.c"
+#include "components.c"
+
+// Sequential lens runs traced with ray transfer matrices. A run is a row of
+// parallel lenses, each overlapping the next across the axis, with nothing
+// else in the band they span. A ray that leaves the first lens heading down
+// the row can only hit the lenses in order, so instead of searching for each
+// hit it is carried through with the run's ABCD matrices.
+//
+// A ray is described by its height y across the axis and its slope m against
+// it. Between lenses y' = y + m d, and a lens centered at height e maps
+// m' = m - (y - e) / f, which is exactly what refract_lens does to the slope.
+// The lens centers need not line up, so the matrices are 2x3, acting on
+// (y, m, 1). They are composed when the runs are found and cached until a
+// lens changes.
+//
+// Every run is stored once for each direction, so either end can be entered.
+
+typedef struct {
+    u32 component;
+    // position of the center along and across the run's axis
+    f32 along;
+    f32 center;
+    f32 half_height;
+    f32 throughput;
+    // height where the ray meets this lens, from its state leaving the first
+    f32 row[3];
+} ParaxialLens;
+
+typedef struct {
+    ParaxialLens *data;
+    usize length;
+    usize capacity;
+} ParaxialLenses;
+
+// `lenses` [first, first + count) in the order a ray meets them. `matrix`
+// takes (y, m, 1) leaving the first lens to (y, m) leaving the last.
+// `transmission` is the smallest fraction of its intensity a ray keeps on the
+// way to any lens after the first.
+typedef struct {
+    Vector2 origin;
+    Vector2 axis;
+    Vector2 across;
+    u32 first;
+    u32 count;
+    f32 matrix[2][3];
+    f32 transmission;
+} ParaxialRun;
+
+typedef struct {
+    ParaxialRun *data;
+    usize length;
+    usize capacity;
+} ParaxialRuns;
+
+typedef struct {
+    u32 *data;
+    usize length;
+    usize capacity;
+} ParaxialEntries;
+
+// `entries` holds, for every component, the run it is the first lens of, or
+// PARAXIAL_NONE. Like the grid, it is rebuilt after any edit; `scratch` holds
+// the build's working memory between builds.
+typedef struct {
+    bool enabled;
+    ParaxialLenses lenses;
+    ParaxialRuns runs;
+    ParaxialEntries entries;
+    Arena scratch;
+    usize component_count;
+    bool stale;
+    bool built;
+} Paraxial;
+
+// A ray in a run's frame.
+typedef struct {
+    f32 height;
+    f32 slope;
+} ParaxialState;
+
+// Lenses that could join a run, sorted by the angle of their normal.
+typedef struct {
+    u32 component;
+    f32 angle;
+    f32 along;
+} ParaxialCandidate;
+
+static int ParaxialCandidate_CompareAngle(const void *a, const void *b) {
+    f32 angle_a = ((ParaxialCandidate *) a)->angle;
+    f32 angle_b = ((ParaxialCandidate *) b)->angle;
+    return (angle_a > angle_b) - (angle_a < angle_b);
+}
+
+static int ParaxialCandidate_CompareAlong(const void *a, const void *b) {
+    f32 along_a = ((ParaxialCandidate *) a)->along;
+    f32 along_b = ((ParaxialCandidate *) b)->along;
+    return (along_a > along_b) - (along_a < along_b);
+}
+
+// Whether `line` crosses the box [along_min, along_max] x [across_min,
+// across_max] in the frame of `origin`, `axis` and `across`.
+static bool paraxial_crosses(Line *line, Vector2 *origin, Vector2 *axis, Vector2 *across, f32 along_min, f32 along_max, f32 across_min, f32 across_max) {
+    Vector2 start = Vector2_Subtract(&line->start, origin);
+    Vector2 end = Vector2_Subtract(&line->end, origin);
+    f32 s_0 = Vector2_Dot(&start, axis), s_1 = Vector2_Dot(&end, axis);
+    f32 e_0 = Vector2_Dot(&start, across), e_1 = Vector2_Dot(&end, across);
+
+    f32 low = 0, high = 1;
+    f32 bounds[2][2] = { { along_min, along_max }, { across_min, across_max } };
+    f32 starts[2] = { s_0, e_0 };
+    f32 deltas[2] = { s_1 - s_0, e_1 - e_0 };
+    for (usize i = 0; i < 2; i++) {
+        if (deltas[i] == 0) {
+            if (starts[i] < bounds[i][0] || starts[i] > bounds[i][1]) return false;
+            continue;
+        }
+        f32 t_0 = (bounds[i][0] - starts[i]) / deltas[i];
+        f32 t_1 = (bounds[i][1] - starts[i]) / deltas[i];
+        low = fmaxf(low, fminf(t_0, t_1));
+        high = fminf(high, fmaxf(t_0, t_1));
+    }
+    return low <= high;
+}
+
+// Adds the run through `chain`, in order along `axis`, and composes its
+// matrices. The run's frame is centered on its first lens.
+static void Paraxial_AddRun(Paraxial *paraxial, Components *components, u32 *chain, usize count, Vector2 axis, Arena *arena) {
+    ParaxialRun run = {
+        .origin = Components_Get(components, chain[0])->center,
+        .axis = axis,
+        .across = { -axis.y, axis.x },
+        .first = paraxial->lenses.length,
+        .count = count,
+        .transmission = 1
+    };
+
+    // (y, m) at the current lens as affine functions of (y, m, 1) leaving the
+    // first, in doubles so long runs don't drift
+    f64 y[3] = { 1, 0, 0 };
+    f64 m[3] = { 0, 1, 0 };
+    f64 previous = 0;
+    f64 intensity = 1;
+    for (usize k = 0; k < count; k++) {
+        Component *component = Components_Get(components, chain[k]);
+        Vector2 offset = Vector2_Subtract(&component->center, &run.origin);
+        ParaxialLens lens = {
+            .component = chain[k],
+            .along = Vector2_Dot(&offset, &run.axis),
+            .center = Vector2_Dot(&offset, &run.across),
+            .half_height = 0.5f * Vector2_Distance(&component->line.start, &component->line.end),
+            .throughput = component->throughput
+        };
+
+        if (k > 0) {
+            f64 distance = lens.along - previous;
+            for (usize i = 0; i < 3; i++) y[i] += m[i] * distance;
+            // the first lens already acted on the ray
+            for (usize i = 0; i < 3; i++) m[i] -= y[i] / component->focal_length;
+            m[2] += lens.center / component->focal_length;
+            if (k < count - 1) {
+                intensity *= component->throughput;
+                if (intensity < run.transmission) run.transmission = intensity;
+            }
+        }
+        for (usize i = 0; i < 3; i++) lens.row[i] = y[i];
+        previous = lens.along;
+        *List_Push(&paraxial->lenses, arena) = lens;
+    }
+
+    for (usize i = 0; i < 3; i++) {
+        run.matrix[0][i] = y[i];
+        run.matrix[1][i] = m[i];
+    }
+    paraxial->entries.data[chain[0]] = paraxial->runs.length;
+    *List_Push(&paraxial->runs, arena) = run;
+}
+
+// Checks that nothing but `chain` lies in the band it spans, and adds the run
+// in both directions. `members` is all false, and is again on return.
+static void Paraxial_AddChain(Paraxial *paraxial, Components *components, u32 *chain, usize count, Vector2 axis, bool *members, Arena *arena) {
+    Vector2 across = { -axis.y, axis.x };
+    Vector2 origin = { 0, 0 };
+    f32 along_min = FLT_MAX, along_max = -FLT_MAX, across_min = FLT_MAX, across_max = -FLT_MAX;
+    for (usize k = 0; k < count; k++) {
+        Component *component = Components_Get(components, chain[k]);
+        f32 along = Vector2_Dot(&component->center, &axis);
+        f32 center = Vector2_Dot(&component->center, &across);
+        f32 half_height = 0.5f * Vector2_Distance(&component->line.start, &component->line.end);
+        along_min = fminf(along_min, along);
+        along_max = fmaxf(along_max, along);
+        across_min = fminf(across_min, center - half_height);
+        across_max = fmaxf(across_max, center + half_height);
+    }
+    // the lenses lean by up to PARAXIAL_MAX_TILT
+    f32 margin = PARAXIAL_MARGIN + PARAXIAL_MAX_TILT * (across_max - across_min);
+    along_min -= margin;
+    along_max += margin;
+
+    for (usize k = 0; k < count; k++) members[chain[k]] = true;
+    bool clear = true;
+    for (usize i = 0; i < components->length && clear; i++) {
+        if (members[i]) continue;
+        Line *line = &Components_Get(components, i)->line;
+        clear = !paraxial_crosses(line, &origin, &axis, &across, along_min, along_max, across_min, across_max);
+    }
+    for (usize k = 0; k < count; k++) members[chain[k]] = false;
+    if (!clear) return;
+
+    Paraxial_AddRun(paraxial, components, chain, count, axis, arena);
+    // and back the other way
+    for (usize k = 0; k < count / 2; k++) {
+        u32 swap = chain[k];
+        chain[k] = chain[count - 1 - k];
+        chain[count - 1 - k] = swap;
+    }
+    Paraxial_AddRun(paraxial, components, chain, count, (Vector2) { -axis.x, -axis.y }, arena);
+}
+
+// Finds the runs among lenses of one direction, sorted along `axis`: every
+// lens that overlaps the one before it across the axis continues its chain.
+static void Paraxial_AddCluster(Paraxial *paraxial, Components *components, ParaxialCandidate *cluster, usize count, Vector2 axis, u32 *chain, bool *members, Arena *arena) {
+    Vector2 across = { -axis.y, axis.x };
+    for (usize k = 0; k < count; k++) {
+        cluster[k].along = Vector2_Dot(&Components_Get(components, cluster[k].component)->center, &axis);
+    }
+    qsort(cluster, count, sizeof(*cluster), ParaxialCandidate_CompareAlong);
+
+    usize length = 0;
+    for (usize k = 0; k <= count; k++) {
+        bool joins = false;
+        if (k < count && length > 0) {
+            Component *last = Components_Get(components, chain[length - 1]);
+            Component *next = Components_Get(components, cluster[k].component);
+            f32 gap = fabsf(Vector2_Dot(&next->center, &across) - Vector2_Dot(&last->center, &across));
+            f32 reach = 0.5f * (Vector2_Distance(&last->line.start, &last->line.end) + Vector2_Distance(&next->line.start, &next->line.end));
+            joins = gap < reach && cluster[k].along - cluster[k - 1].along > PARAXIAL_MARGIN;
+        }
+        if (joins) {
+            chain[length++] = cluster[k].component;
+            continue;
+        }
+        if (length >= 2) Paraxial_AddChain(paraxial, components, chain, length, axis, members, arena);
+        length = 0;
+        if (k < count) chain[length++] = cluster[k].component;
+    }
+}
+
+// Finds every run from scratch, reusing the memory of the last build.
+void Paraxial_Build(Paraxial *paraxial, Components *components, Arena *arena) {
+    paraxial->lenses.length = 0;
+    paraxial->runs.length = 0;
+    paraxial->entries.length = 0;
+    List_Reserve(&paraxial->entries, components->length, arena);
+    paraxial->entries.length = components->length;
+    for (usize i = 0; i < components->length; i++) paraxial->entries.data[i] = PARAXIAL_NONE;
+    paraxial->component_count = components->length;
+    paraxial->stale = false;
+    paraxial->built = true;
+
+    Arena *scratch = &paraxial->scratch;
+    Arena_Reset(scratch);
+    ParaxialCandidate *candidates = Arena_Alloc(scratch, ParaxialCandidate, components->length + 1);
+    u32 *chain = Arena_Alloc(scratch, u32, components->length + 1);
+    bool *members = Arena_Alloc(scratch, bool, components->length + 1);
+
+    // dispersive lenses split white rays, so they are left to the tracer
+    usize count = 0;
+    for (usize i = 0; i < components->length; i++) {
+        Component *component = Components_Get(components, i);
+        if (component->kind != COMPONENT_LENS || component->dispersion != 0 || component->focal_length == 0) continue;
+        if (component->line.start.x == component->line.end.x && component->line.start.y == component->line.end.y) continue;
+        // normals that differ only in sign are the same direction
+        f32 angle = atan2f(component->normal.y, component->normal.x);
+        if (angle < 0) angle += PI;
+        if (angle >= PI) angle -= PI;
+        candidates[count++] = (ParaxialCandidate) { .component = i, .angle = angle };
+    }
+    qsort(candidates, count, sizeof(*candidates), ParaxialCandidate_CompareAngle);
+
+    // start after the widest gap between angles, so a cluster around 0 = PI
+    // isn't cut in two
+    usize start = 0;
+    f32 widest = count > 0 ? candidates[0].angle + PI - candidates[count - 1].angle : 0;
+    for (usize i = 1; i < count; i++) {
+        if (candidates[i].angle - candidates[i - 1].angle > widest) {
+            widest = candidates[i].angle - candidates[i - 1].angle;
+            start = i;
+        }
+    }
+    ParaxialCandidate *sorted = Arena_Alloc(scratch, ParaxialCandidate, count + 1);
+    for (usize i = 0; i < count; i++) {
+        sorted[i] = candidates[(start + i) % count];
+        if (start + i >= count) sorted[i].angle += PI;
+    }
+
+    // clusters of lenses within PARAXIAL_MAX_TILT of the first one's angle
+    for (usize first = 0; first < count;) {
+        usize last = first + 1;
+        while (last < count && sorted[last].angle - sorted[first].angle <= PARAXIAL_MAX_TILT) last++;
+        if (last - first >= 2) {
+            Vector2 axis = { cosf(sorted[first].angle), sinf(sorted[first].angle) };
+            Paraxial_AddCluster(paraxial, components, sorted + first, last - first, axis, chain, members, arena);
+        }
+        first = last;
+    }
+}
+
+// Rebuilds the runs if components were added, moved, removed or changed since
+// the last build.
+void Paraxial_Update(Paraxial *paraxial, Components *components, Arena *arena) {
+    if (paraxial->built && !paraxial->stale && paraxial->component_count == components->length) return;
+    Paraxial_Build(paraxial, components, arena);
+}
+
+// The run that component `index` is the first lens of, or NULL.
+ParaxialRun *Paraxial_Run(Paraxial *paraxial, usize index) {
+    if (index >= paraxial->entries.length || paraxial->entries.data[index] == PARAXIAL_NONE) return NULL;
+    return paraxial->runs.data + paraxial->entries.data[index];
+}
+
+// Whether `ray`, leaving the first lens of `run`, heads down it.
+bool ParaxialRun_Enters(ParaxialRun *run, Ray *ray) {
+    return Vector2_Dot(&ray->direction, &run->axis) > 0;
+}
+
+// State of a ray leaving the first lens of `run`, which it must enter.
+ParaxialState ParaxialRun_Enter(ParaxialRun *run, Ray *ray) {
+    Vector2 offset = Vector2_Subtract(&ray->start, &run->origin);
+    return (ParaxialState) {
+        .height = Vector2_Dot(&offset, &run->across),
+        .slope = Vector2_Dot(&ray->direction, &run->across) / Vector2_Dot(&ray->direction, &run->axis)
+    };
+}
+
+// Carries `count` rays leaving the first lens of `run` through to the last,
+// replacing each state with the one leaving the last lens. `inside[r]` is
+// cleared for rays that would pass within PARAXIAL_MARGIN of a lens edge or
+// miss a lens, whose states are left alone. Lens by lens, then ray by ray, so
+// the inner loop is a batch of independent multiply-adds.
+void ParaxialRun_Propagate(Paraxial *paraxial, ParaxialRun *run, ParaxialState *states, u32 count, bool *inside) {
+    for (u32 r = 0; r < count; r++) inside[r] = true;
+    for (u32 k = 1; k < run->count; k++) {
+        ParaxialLens *lens = paraxial->lenses.data + run->first + k;
+        f32 limit = lens->half_height - PARAXIAL_MARGIN;
+        for (u32 r = 0; r < count; r++) {
+            f32 height = lens->row[0] * states[r].height + lens->row[1] * states[r].slope + lens->row[2];
+            inside[r] &= fabsf(height - lens->center) <= limit;
+        }
+    }
+
+    for (u32 r = 0; r < count; r++) {
+        if (!inside[r]) continue;
+        ParaxialState state = states[r];
+        states[r] = (ParaxialState) {
+            .height = run->matrix[0][0] * state.height + run->matrix[0][1] * state.slope + run->matrix[0][2],
+            .slope = run->matrix[1][0] * state.height + run->matrix[1][1] * state.slope + run->matrix[1][2]
+        };
+    }
+}
+
+// Where a ray that left the first lens of `run` as `entry` meets its `k`th lens.
+Vector2 ParaxialRun_Point(Paraxial *paraxial, ParaxialRun *run, u32 k, ParaxialState *entry) {
+    ParaxialLens *lens = paraxial->lenses.data + run->first + k;
+    f32 height = lens->row[0] * entry->height + lens->row[1] * entry->slope + lens->row[2];
+    return (Vector2) {
+        run->origin.x + lens->along * run->axis.x + height * run->across.x,
+        run->origin.y + lens->along * run->axis.y + height * run->across.y
+    };
+}
+
+// Unit direction of a ray with slope `state` in `run`'s frame.
+Vector2 ParaxialRun_Direction(ParaxialRun *run, ParaxialState *state) {
+    Vector2 direction = {
+        run->axis.x + state->slope * run->across.x,
+        run->axis.y + state->slope * run->across.y
+    };
+    return Vector2_Normalize(&direction);
+}
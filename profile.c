@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "lib/types.c"
+#include "lib/clock.c"
+#include "lib/raylib.c"
+#include "constants.c"
+
+// Per-frame timers and counters for the frame loop. Each frame's numbers go
+// into a ring buffer of the last PROFILE_FRAMES frames, which the overlay
+// averages and Profiler_Dump writes out as CSV. While the profiler is off,
+// every call returns on its first branch and nothing is timed.
+//
+// Timers are started and stopped in pairs around a section; a timer started
+// more than once in a frame adds up.
+
+typedef enum {
+    PROFILE_INPUT,
+    PROFILE_TRACE,
+    PROFILE_IRRADIANCE,
+    PROFILE_DRAW,
+    PROFILE_TEXT,
+    // EndDrawing, which includes waiting for the target frame rate
+    PROFILE_PRESENT,
+    PROFILE_FRAME,
+    PROFILE_TIMER_COUNT
+} ProfileTimer;
+
+typedef enum {
+    PROFILE_RAYS,
+    PROFILE_BOUNCES,
+    PROFILE_TESTS,
+    PROFILE_SEGMENTS,
+    PROFILE_ARENA_BYTES,
+    PROFILE_COUNTER_COUNT
+} ProfileCounter;
+
+static const char *PROFILE_TIMER_NAMES[PROFILE_TIMER_COUNT] = {
+    "input", "trace", "irradiance", "draw", "text", "present", "frame"
+};
+
+static const char *PROFILE_COUNTER_NAMES[PROFILE_COUNTER_COUNT] = {
+    "rays", "bounces", "tests", "segments", "arena_bytes"
+};
+
+// Timers are in seconds.
+typedef struct {
+    f64 timers[PROFILE_TIMER_COUNT];
+    u64 counters[PROFILE_COUNTER_COUNT];
+} ProfileFrame;
+
+typedef struct {
+    bool enabled;
+    ProfileFrame frames[PROFILE_FRAMES];
+    // the frame being recorded, and how many before it hold data
+    usize frame;
+    usize count;
+    f64 starts[PROFILE_TIMER_COUNT];
+} Profiler;
+
+void Profiler_Begin(Profiler *profiler, ProfileTimer timer) {
+    if (!profiler->enabled) return;
+    profiler->starts[timer] = Clock_Now();
+}
+
+void Profiler_End(Profiler *profiler, ProfileTimer timer) {
+    if (!profiler->enabled) return;
+    profiler->frames[profiler->frame].timers[timer] += Clock_Now() - profiler->starts[timer];
+}
+
+void Profiler_Count(Profiler *profiler, ProfileCounter counter, u64 value) {
+    if (!profiler->enabled) return;
+    profiler->frames[profiler->frame].counters[counter] += value;
+}
+
+// Closes the current frame and starts the next one in the ring.
+void Profiler_EndFrame(Profiler *profiler) {
+    if (!profiler->enabled) return;
+    profiler->frame = (profiler->frame + 1) % PROFILE_FRAMES;
+    if (profiler->count < PROFILE_FRAMES) profiler->count++;
+    profiler->frames[profiler->frame] = (ProfileFrame) { 0 };
+}
+
+// Turns recording on or off. Turning it on starts from an empty ring, with
+// any timer already running counted from now.
+void Profiler_Toggle(Profiler *profiler) {
+    profiler->enabled = !profiler->enabled;
+    if (!profiler->enabled) return;
+    profiler->frame = 0;
+    profiler->count = 0;
+    profiler->frames[0] = (ProfileFrame) { 0 };
+    f64 now = Clock_Now();
+    for (usize i = 0; i < PROFILE_TIMER_COUNT; i++) profiler->starts[i] = now;
+}
+
+// The `age`th most recent finished frame, 0 being the last one.
+static ProfileFrame *Profiler_Frame(Profiler *profiler, usize age) {
+    return profiler->frames + (profiler->frame + PROFILE_FRAMES - 1 - age) % PROFILE_FRAMES;
+}
+
+// Averages over every finished frame in the ring.
+ProfileFrame Profiler_Average(Profiler *profiler) {
+    ProfileFrame average = { 0 };
+    if (profiler->count == 0) return average;
+    for (usize age = 0; age < profiler->count; age++) {
+        ProfileFrame *frame = Profiler_Frame(profiler, age);
+        for (usize i = 0; i < PROFILE_TIMER_COUNT; i++) average.timers[i] += frame->timers[i];
+        for (usize i = 0; i < PROFILE_COUNTER_COUNT; i++) average.counters[i] += frame->counters[i];
+    }
+    for (usize i = 0; i < PROFILE_TIMER_COUNT; i++) average.timers[i] /= profiler->count;
+    for (usize i = 0; i < PROFILE_COUNTER_COUNT; i++) average.counters[i] /= profiler->count;
+    return average;
+}
+
+// Writes the finished frames, oldest first, as CSV with timers in
+// milliseconds. Returns false if the file can't be written.
+bool Profiler_Dump(Profiler *profiler, char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) return false;
+
+    fprintf(file, "frame");
+    for (usize i = 0; i < PROFILE_TIMER_COUNT; i++) fprintf(file, ",%s_ms", PROFILE_TIMER_NAMES[i]);
+    for (usize i = 0; i < PROFILE_COUNTER_COUNT; i++) fprintf(file, ",%s", PROFILE_COUNTER_NAMES[i]);
+    fprintf(file, "\n");
+
+    for (usize k = 0; k < profiler->count; k++) {
+        ProfileFrame *frame = Profiler_Frame(profiler, profiler->count - 1 - k);
+        fprintf(file, "%zu", k);
+        for (usize i = 0; i < PROFILE_TIMER_COUNT; i++) fprintf(file, ",%.4f", frame->timers[i] * 1e3);
+        for (usize i = 0; i < PROFILE_COUNTER_COUNT; i++) fprintf(file, ",%llu", (unsigned long long) frame->counters[i]);
+        fprintf(file, "\n");
+    }
+    return fclose(file) == 0;
+}
+
+// Draws the averages over the ring, one line each, starting at `position`.
+void Profiler_Draw(Profiler *profiler, Font font, Vector2 position) {
+    if (!profiler->enabled) return;
+    ProfileFrame average = Profiler_Average(profiler);
+    for (usize i = 0; i < PROFILE_TIMER_COUNT; i++) {
+        const char *text = TextFormat("%-10s %7.2f ms", PROFILE_TIMER_NAMES[i], average.timers[i] * 1e3);
+        DrawTextEx(font, text, position, TEXT_HEIGHT, TEXT_SPACING, GREEN);
+        position.y += 1.2 * TEXT_HEIGHT;
+    }
+    for (usize i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+        const char *text = TextFormat("%-10s %10llu", PROFILE_COUNTER_NAMES[i], (unsigned long long) average.counters[i]);
+        DrawTextEx(font, text, position, TEXT_HEIGHT, TEXT_SPACING, GREEN);
+        position.y += 1.2 * TEXT_HEIGHT;
+    }
+}
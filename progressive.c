@@ -0,0 +1,183 @@
+#pragma once
+
+#include <math.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/random.c"
+#include "lib/vectors.c"
+#include "constants.c"
+#include "lines.c"
+#include "lights.c"
+#include "trace.c"
+#include "irradiance.c"
+
+// Progressive Monte Carlo rendering of the light sources. Every pass emits a
+// fresh batch of jittered rays from each source (one per stratum of its angle
+// or length), traces them and adds them to an irradiance map, so the image
+// keeps converging for as long as the scene stays still. Sources share a fixed
+// ray budget per pass, which keeps the cost of a frame constant. Any change to
+// the scene throws the accumulated passes away.
+//
+// Each source gets rays in proportion to how many fixed rays it has in
+// `light_rays`, and each ray carries (fixed rays) / (rays this pass) as its
+// intensity, so a converged pass looks like a dense version of the fixed rays.
+// Bare rays have nothing to sample, so each pass traces each of them once as
+// it is.
+
+typedef struct {
+    Random random;
+    Arena arena;
+    Rays rays;
+    LightLines light_lines;
+    TraceStats stats;
+    usize budget;
+    u32 passes;
+    u64 fingerprint;
+} Progressive;
+
+void Progressive_Init(Progressive *progressive, usize budget, u64 seed) {
+    *progressive = (Progressive) {
+        .random = Random_New(seed),
+        .arena = Arena_New(PROGRESSIVE_ARENA_CAPACITY),
+        .budget = budget
+    };
+}
+
+void Progressive_Free(Progressive *progressive) {
+    Arena_Free(&progressive->arena);
+}
+
+// Forgets every pass so far.
+void Progressive_Restart(Progressive *progressive, Irradiance *irradiance) {
+    Irradiance_Clear(irradiance);
+    progressive->stats = (TraceStats) { 0 };
+    progressive->passes = 0;
+}
+
+static u64 fingerprint_add(u64 hash, void *data, usize size) {
+    // FNV-1a
+    u8 *bytes = data;
+    for (usize i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+// Which rays of `light_rays` belong to a source, so the rest are bare.
+static bool *Progressive_Owned(Progressive *progressive, Scene *scene) {
+    bool *owned = Arena_Alloc(&progressive->arena, bool, scene->light_rays.length);
+    for (usize i = 0; i < scene->point_lights.length; i++) {
+        usize *ray_indices = scene->point_lights.data[i].ray_indices;
+        for (usize k = 0; k < POINT_SOURCE_RAY_NUMBER; k++) owned[ray_indices[k]] = true;
+    }
+    for (usize i = 0; i < scene->line_lights.length; i++) {
+        LineLight *line_light = scene->line_lights.data + i;
+        for (u32 k = 0; k < line_light->ray_count; k++) owned[line_light->ray_indices[k]] = true;
+    }
+    return owned;
+}
+
+// Hash of everything that affects the image, to notice when it changes.
+static u64 Progressive_Fingerprint(Scene *scene, bool *owned) {
+    u64 hash = 0xcbf29ce484222325ULL;
+    for (usize i = 0; i < scene->components.length; i++) {
+        Component *component = scene->components.data + i;
+        hash = fingerprint_add(hash, &component->kind, sizeof(component->kind));
+        hash = fingerprint_add(hash, &component->line, sizeof(component->line));
+        hash = fingerprint_add(hash, &component->focal_length, sizeof(component->focal_length));
+        hash = fingerprint_add(hash, &component->dispersion, sizeof(component->dispersion));
+    }
+    for (usize i = 0; i < scene->point_lights.length; i++) {
+        hash = fingerprint_add(hash, &scene->point_lights.data[i].position, sizeof(Vector2));
+    }
+    for (usize i = 0; i < scene->line_lights.length; i++) {
+        hash = fingerprint_add(hash, &scene->line_lights.data[i].line, sizeof(Line));
+    }
+    for (usize i = 0; i < scene->light_rays.length; i++) {
+        if (!owned[i]) hash = fingerprint_add(hash, scene->light_rays.data + i, sizeof(Ray));
+    }
+    hash = fingerprint_add(hash, &scene->options, sizeof(scene->options));
+    hash = fingerprint_add(hash, &scene->paraxial.enabled, sizeof(scene->paraxial.enabled));
+    return hash;
+}
+
+// Rays a source with `weight` fixed rays gets this pass, out of `total`.
+static u32 Progressive_Share(Progressive *progressive, u32 weight, u32 total) {
+    u32 share = (u32) ((u64) progressive->budget * weight / total);
+    return share > 0 ? share : 1;
+}
+
+static void Progressive_Emit(Progressive *progressive, Scene *scene, bool *owned) {
+    Random *random = &progressive->random;
+    Rays *rays = &progressive->rays;
+
+    // a free slot has zero intensity, and would trace to nothing
+    for (usize i = 0; i < scene->light_rays.length; i++) {
+        Ray *ray = scene->light_rays.data + i;
+        if (!owned[i] && ray->intensity > 0) *List_Push(rays, &progressive->arena) = *ray;
+    }
+
+    u32 total = scene->point_lights.length * POINT_SOURCE_RAY_NUMBER;
+    for (usize i = 0; i < scene->line_lights.length; i++) {
+        total += scene->line_lights.data[i].ray_count;
+    }
+    if (total == 0) return;
+
+    for (usize i = 0; i < scene->point_lights.length; i++) {
+        PointLight *point_light = scene->point_lights.data + i;
+        u32 count = Progressive_Share(progressive, POINT_SOURCE_RAY_NUMBER, total);
+        for (u32 k = 0; k < count; k++) {
+            Ray *ray = List_Push(rays, &progressive->arena);
+            *ray = Ray_FromAngle(point_light->position, 2 * PI * (k + Random_F32(random)) / count);
+            ray->intensity = (f32) POINT_SOURCE_RAY_NUMBER / count;
+        }
+    }
+
+    for (usize i = 0; i < scene->line_lights.length; i++) {
+        LineLight *line_light = scene->line_lights.data + i;
+        Vector2 delta = Vector2_Subtract(&line_light->line.end, &line_light->line.start);
+        f32 theta = Vector2_Angle(&delta) - PI / 2;
+
+        u32 weight = line_light->ray_count;
+        u32 count = Progressive_Share(progressive, weight, total);
+        for (u32 k = 0; k < count; k++) {
+            f32 scalar = (k + Random_F32(random)) / count;
+            Vector2 position = {
+                line_light->line.start.x + scalar * delta.x,
+                line_light->line.start.y + scalar * delta.y
+            };
+            Ray *ray = List_Push(rays, &progressive->arena);
+            *ray = Ray_FromAngle(position, theta);
+            ray->intensity = (f32) weight / count;
+        }
+    }
+}
+
+// Runs one pass into `irradiance`, restarting first if the scene changed since
+// the last pass. The scene's accelerator must be up to date. Returns the rays
+// traced.
+usize Progressive_Step(Progressive *progressive, Tracer *tracer, Scene *scene, Irradiance *irradiance) {
+    // the rays and lines of a pass are gone once it is splatted
+    Arena_Reset(&progressive->arena);
+    progressive->rays = (Rays) { 0 };
+    progressive->light_lines = (LightLines) { 0 };
+
+    bool *owned = Progressive_Owned(progressive, scene);
+    u64 fingerprint = Progressive_Fingerprint(scene, owned);
+    if (fingerprint != progressive->fingerprint) {
+        Progressive_Restart(progressive, irradiance);
+        progressive->fingerprint = fingerprint;
+    }
+
+    Progressive_Emit(progressive, scene, owned);
+    Tracer_TraceRays(tracer, scene, &progressive->rays, &progressive->light_lines, &progressive->stats, &progressive->arena);
+    Irradiance_Splat(irradiance, &progressive->light_lines);
+    progressive->passes++;
+
+    return progressive->rays.length;
+}
+
+// Tone maps the running average of every pass.
+void Progressive_ToneMap(Progressive *progressive, Irradiance *irradiance, f32 exposure) {
+    Irradiance_ToneMap(irradiance, progressive->passes > 0 ? exposure / progressive->passes : exposure);
+}
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/vectors.c"
+#include "constants.c"
+#include "lines.c"
+#include "lights.c"
+#include "trace.c"
+#include "cache.c"
+
+// Adaptive refinement of the light sources. The fixed rays of a source are
+// evenly spaced, which wastes them where nothing happens and leaves the edges
+// of mirrors and lenses ragged. Refine compares the cached paths of each pair
+// of neighboring rays of a source, and where they part ways traces a ray
+// halfway between them, which is then compared with both in turn. This goes
+// on for up to REFINE_MAX_DEPTH halvings, breadth first, until `budget` rays
+// have been added, so a budget that runs out leaves every edge refined about
+// as far.
+//
+// Every ray of a source then carries the share of it that it stands for: half
+// the spacing to each neighbor, in fixed ray spacings. A source puts out the
+// same light refined or not, and a fixed ray with no added neighbors keeps its
+// intensity. Bare rays without a source are left as they are.
+
+// A ray of a source, fixed or added. `t` is where it sits along the source, in
+// fixed ray spacings. Fixed rays keep their path in the cache under their slot
+// `ray`; added rays are REFINE_ADDED and keep theirs in `segments`.
+typedef struct {
+    f32 t;
+    u32 source;
+    u32 ray;
+    u32 first;
+    u32 count;
+} RefineSample;
+
+typedef struct {
+    RefineSample *data;
+    usize length;
+    usize capacity;
+} RefineSamples;
+
+// Two neighboring samples, to be compared and maybe split.
+typedef struct {
+    u32 a;
+    u32 b;
+    u32 depth;
+} RefineGap;
+
+typedef struct {
+    RefineGap *data;
+    usize length;
+    usize capacity;
+} RefineGaps;
+
+// A point source goes all the way around, so its last ray neighbors its
+// first.
+typedef struct {
+    bool point;
+    usize index;
+    u32 count;
+} RefineSource;
+
+typedef struct {
+    RefineSource *data;
+    usize length;
+    usize capacity;
+} RefineSources;
+
+typedef struct {
+    u32 source;
+    f32 t;
+    u32 sample;
+} RefineOrder;
+
+typedef struct {
+    Arena arena;
+    usize budget;
+    RefineSources sources;
+    RefineSamples samples;
+    RefineGaps gaps;
+    RefineGaps next;
+    Rays rays;
+    LightLines segments;
+    LightLines light_lines;
+    // what the last run added and the work of tracing it
+    usize added;
+    TraceStats stats;
+} Refine;
+
+void Refine_Init(Refine *refine, usize budget) {
+    *refine = (Refine) {
+        .arena = Arena_New(REFINE_ARENA_CAPACITY),
+        .budget = budget
+    };
+}
+
+void Refine_Free(Refine *refine) {
+    Arena_Free(&refine->arena);
+}
+
+static LightLine *Refine_Path(Refine *refine, TraceCache *cache, u32 sample, u32 *count) {
+    RefineSample *refine_sample = refine->samples.data + sample;
+    if (refine_sample->ray == REFINE_ADDED) {
+        *count = refine_sample->count;
+        return refine->segments.data + refine_sample->first;
+    }
+    LightLines *path = &cache->paths.data[refine_sample->ray].path;
+    *count = path->length;
+    return path->data;
+}
+
+// Whether the paths of two neighboring rays part ways: they hit different
+// components, land more than REFINE_MAX_GAP apart or leave more than
+// REFINE_MAX_TURN apart.
+static bool refine_differs(LightLine *a, u32 a_count, LightLine *b, u32 b_count) {
+    if (a_count != b_count) return true;
+    for (u32 i = 0; i < a_count; i++) {
+        if (a[i].component != b[i].component || a[i].wavelength != b[i].wavelength) return true;
+        if (a[i].component != TRACE_NO_COMPONENT) {
+            if (Vector2_Distance(&a[i].line.end, &b[i].line.end) > REFINE_MAX_GAP) return true;
+            continue;
+        }
+
+        // escaping segments run on for LIGHT_RAY_LENGTH, so their ends are far
+        // apart whenever they are not parallel
+        Vector2 a_vector = Vector2_Subtract(&a[i].line.end, &a[i].line.start);
+        Vector2 b_vector = Vector2_Subtract(&b[i].line.end, &b[i].line.start);
+        f32 cosine = Vector2_Dot(&a_vector, &b_vector) / ((f32) LIGHT_RAY_LENGTH * LIGHT_RAY_LENGTH);
+        if (cosine < cosf(REFINE_MAX_TURN)) return true;
+    }
+    return false;
+}
+
+static Ray Refine_Ray(Scene *scene, RefineSource *source, f32 t) {
+    if (source->point) {
+        PointLight *point_light = PointLights_Get(&scene->point_lights, source->index);
+        return Ray_FromAngle(point_light->position, 2 * PI * t / source->count);
+    }
+    LineLight *line_light = LineLights_Get(&scene->line_lights, source->index);
+    return LineLight_RayAt(line_light, source->count > 1 ? t / (source->count - 1) : 0);
+}
+
+// Adds the fixed rays of a source as samples, and the gaps between them.
+static void Refine_AddSource(Refine *refine, RefineSource source, usize *ray_indices) {
+    u32 first = refine->samples.length;
+    u32 source_index = refine->sources.length;
+    *List_Push(&refine->sources, &refine->arena) = source;
+    for (u32 i = 0; i < source.count; i++) {
+        *List_Push(&refine->samples, &refine->arena) = (RefineSample) { .t = i, .source = source_index, .ray = ray_indices[i] };
+    }
+
+    u32 gaps = source.point ? source.count : source.count - 1;
+    for (u32 i = 0; i < gaps; i++) {
+        *List_Push(&refine->gaps, &refine->arena) = (RefineGap) { first + i, first + (i + 1) % source.count, 0 };
+    }
+}
+
+static int RefineOrder_Compare(const void *a, const void *b) {
+    const RefineOrder *x = a, *y = b;
+    if (x->source != y->source) return x->source < y->source ? -1 : 1;
+    return (x->t > y->t) - (x->t < y->t);
+}
+
+// How much of its source each sample stands for, indexed like `samples`.
+static f32 *Refine_Weights(Refine *refine) {
+    usize count = refine->samples.length;
+    f32 *weights = Arena_Alloc(&refine->arena, f32, count);
+    RefineOrder *order = Arena_Alloc(&refine->arena, RefineOrder, count);
+    for (usize i = 0; i < count; i++) {
+        order[i] = (RefineOrder) { refine->samples.data[i].source, refine->samples.data[i].t, i };
+    }
+    qsort(order, count, sizeof(RefineOrder), RefineOrder_Compare);
+
+    for (usize first = 0, last; first < count; first = last) {
+        RefineSource *source = refine->sources.data + order[first].source;
+        for (last = first; last < count && order[last].source == order[first].source; last++);
+        for (usize i = first; i < last; i++) {
+            // a line source's end rays stand for a fixed spacing past the end
+            f32 left = 1, right = 1;
+            if (i > first) left = order[i].t - order[i - 1].t;
+            else if (source->point) left = order[i].t + source->count - order[last - 1].t;
+            if (i + 1 < last) right = order[i + 1].t - order[i].t;
+            else if (source->point) right = order[first].t + source->count - order[i].t;
+            weights[order[i].sample] = (left + right) / 2;
+        }
+    }
+    return weights;
+}
+
+static void refine_push_path(LightLines *light_lines, LightLine *path, u32 count, f32 weight) {
+    for (u32 i = 0; i < count; i++) {
+        LightLine *light_line = light_lines->data + light_lines->length++;
+        *light_line = path[i];
+        light_line->intensity *= weight;
+    }
+}
+
+// Refines every source of `scene` against the cached paths of its fixed rays,
+// which must be up to date, and rebuilds `light_lines` from the cached and the
+// added paths. Returns the rays added.
+usize Refine_Run(Refine *refine, Tracer *tracer, Scene *scene, TraceCache *cache) {
+    Arena_Reset(&refine->arena);
+    refine->sources = (RefineSources) { 0 };
+    refine->samples = (RefineSamples) { 0 };
+    refine->gaps = (RefineGaps) { 0 };
+    refine->next = (RefineGaps) { 0 };
+    refine->rays = (Rays) { 0 };
+    refine->segments = (LightLines) { 0 };
+    refine->light_lines = (LightLines) { 0 };
+    refine->added = 0;
+    refine->stats = (TraceStats) { 0 };
+
+    for (usize i = 0; i < scene->point_lights.length; i++) {
+        RefineSource source = { .point = true, .index = i, .count = POINT_SOURCE_RAY_NUMBER };
+        Refine_AddSource(refine, source, scene->point_lights.data[i].ray_indices);
+    }
+    for (usize i = 0; i < scene->line_lights.length; i++) {
+        LineLight *line_light = scene->line_lights.data + i;
+        RefineSource source = { .point = false, .index = i, .count = line_light->ray_count };
+        Refine_AddSource(refine, source, line_light->ray_indices);
+    }
+    usize fixed = refine->samples.length;
+
+    // one round per depth, with every gap that parts ways split at once
+    while (refine->gaps.length > 0) {
+        refine->rays.length = 0;
+        refine->next.length = 0;
+        u32 first_sample = refine->samples.length;
+        for (usize i = 0; i < refine->gaps.length; i++) {
+            RefineGap gap = refine->gaps.data[i];
+            if (gap.depth == REFINE_MAX_DEPTH || refine->added + refine->rays.length == refine->budget) continue;
+            u32 a_count, b_count;
+            LightLine *a = Refine_Path(refine, cache, gap.a, &a_count);
+            LightLine *b = Refine_Path(refine, cache, gap.b, &b_count);
+            if (!refine_differs(a, a_count, b, b_count)) continue;
+
+            RefineSample *a_sample = refine->samples.data + gap.a;
+            RefineSource *source = refine->sources.data + a_sample->source;
+            f32 b_t = refine->samples.data[gap.b].t;
+            // the gap from a point source's last ray wraps around to its first
+            f32 t = (a_sample->t + (b_t > a_sample->t ? b_t : b_t + source->count)) / 2;
+            if (t >= source->count) t -= source->count;
+
+            u32 middle = refine->samples.length;
+            *List_Push(&refine->samples, &refine->arena) = (RefineSample) { .t = t, .source = a_sample->source, .ray = REFINE_ADDED };
+            *List_Push(&refine->rays, &refine->arena) = Refine_Ray(scene, source, t);
+            *List_Push(&refine->next, &refine->arena) = (RefineGap) { gap.a, middle, gap.depth + 1 };
+            *List_Push(&refine->next, &refine->arena) = (RefineGap) { middle, gap.b, gap.depth + 1 };
+        }
+        if (refine->rays.length == 0) break;
+
+        // the tracer keeps where each ray's segments went until its next run
+        usize offset = refine->segments.length;
+        Tracer_TraceRays(tracer, scene, &refine->rays, &refine->segments, &refine->stats, &refine->arena);
+        for (usize i = 0; i < refine->rays.length; i++) {
+            RefineSample *sample = refine->samples.data + first_sample + i;
+            sample->first = offset;
+            sample->count = tracer->spans[i].count;
+            offset += sample->count;
+        }
+
+        refine->added += refine->rays.length;
+        RefineGaps swap = refine->gaps;
+        refine->gaps = refine->next;
+        refine->next = swap;
+    }
+
+    f32 *weights = Refine_Weights(refine);
+    f32 *ray_weights = Arena_Alloc(&refine->arena, f32, cache->paths.length);
+    for (usize i = 0; i < cache->paths.length; i++) ray_weights[i] = 1;
+    for (usize i = 0; i < fixed; i++) ray_weights[refine->samples.data[i].ray] = weights[i];
+
+    usize total = refine->segments.length;
+    for (usize i = 0; i < cache->paths.length; i++) total += cache->paths.data[i].path.length;
+    List_Reserve(&refine->light_lines, total, &refine->arena);
+    for (usize i = 0; i < cache->paths.length; i++) {
+        LightLines *path = &cache->paths.data[i].path;
+        refine_push_path(&refine->light_lines, path->data, path->length, ray_weights[i]);
+    }
+    for (usize i = fixed; i < refine->samples.length; i++) {
+        RefineSample *sample = refine->samples.data + i;
+        refine_push_path(&refine->light_lines, refine->segments.data + sample->first, sample->count, weights[i]);
+    }
+    return refine->added;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <math.h>
+#include <stdbool.h>
+
+#include "lib/types.c"
+#include "lib/raylib.c"
+#include "constants.c"
+#include "lines.c"
+#include "components.c"
+#include "spectrum.c"
+#include "trace.c"
+
+// Draws every light line and component through one rlgl render batch sized to
+// hold them all, so a frame is a single draw call instead of one `DrawLine`
+// per segment. Only rlgl is used, so it runs the same on a software GL context
+// (e.g. Mesa's llvmpipe) as on a GPU.
+
+typedef struct {
+    rlRenderBatch batch;
+    usize capacity;
+    bool loaded;
+} LineRenderer;
+
+void LineRenderer_Free(LineRenderer *renderer) {
+    if (renderer->loaded) rlUnloadRenderBatch(renderer->batch);
+    *renderer = (LineRenderer) { 0 };
+}
+
+// Makes sure the batch holds at least `segments` lines, up to
+// RENDER_BATCH_MAX_SEGMENTS; past that rlgl flushes the batch as it fills up.
+static void LineRenderer_Reserve(LineRenderer *renderer, usize segments) {
+    if (renderer->loaded && (segments <= renderer->capacity || renderer->capacity == RENDER_BATCH_MAX_SEGMENTS)) return;
+
+    usize capacity = renderer->capacity ? renderer->capacity : RENDER_BATCH_MIN_SEGMENTS;
+    while (capacity < segments && capacity < RENDER_BATCH_MAX_SEGMENTS) capacity *= 2;
+    if (capacity > RENDER_BATCH_MAX_SEGMENTS) capacity = RENDER_BATCH_MAX_SEGMENTS;
+
+    LineRenderer_Free(renderer);
+    // batch elements are quads of four vertices, i.e. two lines each
+    renderer->batch = rlLoadRenderBatch(1, (capacity + 1) / 2);
+    renderer->capacity = capacity;
+    renderer->loaded = true;
+}
+
+static void LineRenderer_Push(Line *line, Color color) {
+    rlCheckRenderBatchLimit(2);
+    rlColor4ub(color.r, color.g, color.b, color.a);
+    rlVertex2f(line->start.x, line->start.y);
+    rlVertex2f(line->end.x, line->end.y);
+}
+
+// Must be called between BeginDrawing and EndDrawing.
+void LineRenderer_Draw(LineRenderer *renderer, LightLines *light_lines, Components *components) {
+    LineRenderer_Reserve(renderer, light_lines->length + components->length);
+
+    rlSetRenderBatchActive(&renderer->batch);
+    rlBegin(RL_LINES);
+
+    for (usize i = 0; i < light_lines->length; i++) {
+        LightLine *light_line = light_lines->data + i;
+        // a split ray's colors share its intensity, but each is drawn as
+        // bright as the white ray was
+        f32 intensity = light_line->intensity * (light_line->wavelength > 0 ? SPECTRUM_SAMPLES : 1);
+        intensity = intensity < 1 ? intensity : 1;
+        Vector3 color = Spectrum_Color(light_line->wavelength);
+        f32 peak = fmaxf(color.x, fmaxf(color.y, color.z));
+        LineRenderer_Push(&light_line->line, (Color) {
+            (u8) (255 * color.x / peak), (u8) (255 * color.y / peak), (u8) (255 * color.z / peak), (u8) (255 * intensity)
+        });
+    }
+
+    for (usize i = 0; i < components->length; i++) {
+        Component *component = components->data + i;
+        Color color = component->kind != COMPONENT_LENS ? GRAY : component->dispersion != 0 ? PURPLE : BLUE;
+        LineRenderer_Push(&component->line, color);
+    }
+
+    rlEnd();
+    // switching back draws the batch and returns to raylib's default one
+    rlSetRenderBatchActive(NULL);
+}
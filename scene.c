@@ -0,0 +1,413 @@
+#pragma once
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/mapping.c"
+#include "lib/pool.c"
+#include "lib/slotmap.c"
+#include "lib/vectors.c"
+
+#include "constants.c"
+#include "lines.c"
+#include "lights.c"
+#include "components.c"
+#include "bvh.c"
+#include "grid.c"
+#include "paraxial.c"
+
+// Limits that keep the cost of a single ray bounded, e.g. between two facing
+// mirrors.
+typedef struct {
+    u32 max_bounces;
+    f32 min_intensity;
+} TraceOptions;
+
+// How the tracer finds the closest hit of a ray. Brute force tests every
+// component and is there to compare the others against.
+typedef enum {
+    ACCELERATOR_BVH,
+    ACCELERATOR_GRID,
+    ACCELERATOR_BRUTE,
+    ACCELERATOR_COUNT
+} Accelerator;
+
+char *const ACCELERATOR_NAMES[ACCELERATOR_COUNT] = { "bvh", "grid", "brute" };
+
+typedef struct {
+    usize *data;
+    usize length;
+    usize capacity;
+} RayIndices;
+
+// Everything the tracer needs to know about a scene, independent of any window
+// or frame loop.
+//
+// The scene owns its memory. Removed sources give their ray slots back through
+// `free_rays` (a free slot has zero intensity and traces to nothing) and their
+// index lists back to `pool`, and removed components are swapped out of the
+// list, so edits reuse memory instead of growing the arena.
+//
+// Sources and components are named by handles from their slot maps, which stay
+// valid while the lists underneath are reordered by removals. Every edit is
+// O(1) apart from the rays it touches, and is logged in `changed_rays` and
+// `changed_regions` for TraceCache_Update to pick up, so components and
+// sources must only be added through the Scene_* functions. Bare rays may be
+// pushed onto `light_rays` directly.
+//
+// A scene loaded from a file (see scenefile.c) starts out with `light_rays`
+// and `components` pointing straight into `mapping`. They move into the arena
+// the first time they grow.
+typedef struct {
+    Rays light_rays;
+    Components components;
+    PointLights point_lights;
+    LineLights line_lights;
+    TraceOptions options;
+    Accelerator accelerator;
+    Bvh bvh;
+    Grid grid;
+    Paraxial paraxial;
+
+    SlotMap component_handles;
+    SlotMap point_light_handles;
+    SlotMap line_light_handles;
+
+    Arena arena;
+    Mapping mapping;
+    Pool pool;
+    RayIndices free_rays;
+
+    RayIndices changed_rays;
+    Lines changed_regions;
+} Scene;
+
+Scene Scene_New() {
+    return (Scene) {
+        .options = {
+            .max_bounces = MAX_BOUNCES,
+            .min_intensity = MIN_INTENSITY
+        }
+    };
+}
+
+void Scene_Free(Scene *scene) {
+    Arena_Free(&scene->arena);
+    Arena_Free(&scene->paraxial.scratch);
+    Mapping_Close(&scene->mapping);
+    *scene = Scene_New();
+}
+
+static usize Scene_AcquireRay(Scene *scene, Ray ray) {
+    if (scene->free_rays.length == 0) {
+        *List_Push(&scene->light_rays, &scene->arena) = ray;
+        return scene->light_rays.length - 1;
+    }
+
+    usize index = scene->free_rays.data[--scene->free_rays.length];
+    *Rays_Get(&scene->light_rays, index) = ray;
+    *List_Push(&scene->changed_rays, &scene->arena) = index;
+    return index;
+}
+
+static void Scene_ReleaseRay(Scene *scene, usize index) {
+    Rays_Get(&scene->light_rays, index)->intensity = 0;
+    *List_Push(&scene->free_rays, &scene->arena) = index;
+    *List_Push(&scene->changed_rays, &scene->arena) = index;
+}
+
+static void Scene_MarkRegion(Scene *scene, Line *line) {
+    *List_Push(&scene->changed_regions, &scene->arena) = *line;
+}
+
+Handle Scene_AddPointLight(Scene *scene, Vector2 *position) {
+    usize *ray_indices = Pool_Alloc(&scene->pool, POINT_SOURCE_RAY_NUMBER * sizeof(usize), &scene->arena);
+    for (usize i = 0; i < POINT_SOURCE_RAY_NUMBER; i++) {
+        ray_indices[i] = Scene_AcquireRay(scene, Ray_FromAngle(*position, 2 * PI * i / POINT_SOURCE_RAY_NUMBER));
+    }
+
+    *List_Push(&scene->point_lights, &scene->arena) = (PointLight) {
+        .position = *position,
+        .ray_indices = ray_indices
+    };
+    return SlotMap_Insert(&scene->point_light_handles, &scene->arena);
+}
+
+// NULL if `handle` is stale.
+PointLight *Scene_GetPointLight(Scene *scene, Handle handle) {
+    usize index;
+    if (!SlotMap_Find(&scene->point_light_handles, handle, &index)) return NULL;
+    return scene->point_lights.data + index;
+}
+
+bool Scene_MovePointLight(Scene *scene, Handle handle, Vector2 *position) {
+    PointLight *point_light = Scene_GetPointLight(scene, handle);
+    if (!point_light) return false;
+
+    PointLight_Update(point_light, &scene->light_rays, position);
+    for (usize i = 0; i < POINT_SOURCE_RAY_NUMBER; i++) {
+        *List_Push(&scene->changed_rays, &scene->arena) = point_light->ray_indices[i];
+    }
+    return true;
+}
+
+bool Scene_RemovePointLight(Scene *scene, Handle handle) {
+    usize index;
+    if (!SlotMap_Remove(&scene->point_light_handles, handle, &index)) return false;
+
+    PointLight *point_light = scene->point_lights.data + index;
+    for (usize i = 0; i < POINT_SOURCE_RAY_NUMBER; i++) Scene_ReleaseRay(scene, point_light->ray_indices[i]);
+    Pool_Free(&scene->pool, point_light->ray_indices, POINT_SOURCE_RAY_NUMBER * sizeof(usize));
+
+    *point_light = scene->point_lights.data[--scene->point_lights.length];
+    return true;
+}
+
+// Points the rays of `line_light` at fresh slots matching its line.
+static void Scene_EmitLineLight(Scene *scene, LineLight *line_light) {
+    line_light->ray_count = LineLight_RayNumber(line_light);
+    line_light->ray_indices = Pool_Alloc(&scene->pool, line_light->ray_count * sizeof(usize), &scene->arena);
+    for (u32 i = 0; i < line_light->ray_count; i++) {
+        line_light->ray_indices[i] = Scene_AcquireRay(scene, LineLight_Ray(line_light, i));
+    }
+}
+
+static void Scene_ReleaseLineLight(Scene *scene, LineLight *line_light) {
+    for (u32 i = 0; i < line_light->ray_count; i++) Scene_ReleaseRay(scene, line_light->ray_indices[i]);
+    Pool_Free(&scene->pool, line_light->ray_indices, line_light->ray_count * sizeof(usize));
+}
+
+Handle Scene_AddLineLight(Scene *scene, Line *line) {
+    LineLight *line_light = List_Push(&scene->line_lights, &scene->arena);
+    *line_light = (LineLight) { .line = *line };
+    Scene_EmitLineLight(scene, line_light);
+    return SlotMap_Insert(&scene->line_light_handles, &scene->arena);
+}
+
+// NULL if `handle` is stale.
+LineLight *Scene_GetLineLight(Scene *scene, Handle handle) {
+    usize index;
+    if (!SlotMap_Find(&scene->line_light_handles, handle, &index)) return NULL;
+    return scene->line_lights.data + index;
+}
+
+bool Scene_MoveLineLight(Scene *scene, Handle handle, Line *line) {
+    LineLight *line_light = Scene_GetLineLight(scene, handle);
+    if (!line_light) return false;
+
+    LineLight moved = { .line = *line };
+    if (LineLight_RayNumber(&moved) != line_light->ray_count) {
+        // a different length needs a different number of rays
+        Scene_ReleaseLineLight(scene, line_light);
+        line_light->line = *line;
+        Scene_EmitLineLight(scene, line_light);
+        return true;
+    }
+
+    line_light->line = *line;
+    for (u32 i = 0; i < line_light->ray_count; i++) {
+        usize ray_index = line_light->ray_indices[i];
+        *Rays_Get(&scene->light_rays, ray_index) = LineLight_Ray(line_light, i);
+        *List_Push(&scene->changed_rays, &scene->arena) = ray_index;
+    }
+    return true;
+}
+
+bool Scene_RemoveLineLight(Scene *scene, Handle handle) {
+    usize index;
+    if (!SlotMap_Remove(&scene->line_light_handles, handle, &index)) return false;
+
+    LineLight *line_light = scene->line_lights.data + index;
+    Scene_ReleaseLineLight(scene, line_light);
+    *line_light = scene->line_lights.data[--scene->line_lights.length];
+    return true;
+}
+
+Handle Scene_AddMirror(Scene *scene, Line *line) {
+    Components_AddMirror(&scene->components, line, &scene->arena);
+    Scene_MarkRegion(scene, line);
+    return SlotMap_Insert(&scene->component_handles, &scene->arena);
+}
+
+Handle Scene_AddLens(Scene *scene, Line *line, f32 focal_length) {
+    Components_AddLens(&scene->components, line, focal_length, &scene->arena);
+    Scene_MarkRegion(scene, line);
+    return SlotMap_Insert(&scene->component_handles, &scene->arena);
+}
+
+// NULL if `handle` is stale.
+Component *Scene_GetComponent(Scene *scene, Handle handle) {
+    usize index;
+    if (!SlotMap_Find(&scene->component_handles, handle, &index)) return NULL;
+    return scene->components.data + index;
+}
+
+bool Scene_MoveComponent(Scene *scene, Handle handle, Line *line) {
+    Component *component = Scene_GetComponent(scene, handle);
+    if (!component) return false;
+
+    Scene_MarkRegion(scene, &component->line);
+    Scene_MarkRegion(scene, line);
+    component->line = *line;
+    Component_Update(component);
+    // refit once per frame in Bvh_Update, however many components moved
+    scene->bvh.refit = true;
+    scene->grid.stale = true;
+    scene->paraxial.stale = true;
+    return true;
+}
+
+// Only lenses have a focal length; returns false for anything else.
+bool Scene_SetFocalLength(Scene *scene, Handle handle, f32 focal_length) {
+    Component *component = Scene_GetComponent(scene, handle);
+    if (!component || component->kind != COMPONENT_LENS) return false;
+
+    component->focal_length = focal_length;
+    Scene_MarkRegion(scene, &component->line);
+    scene->paraxial.stale = true;
+    return true;
+}
+
+// Only lenses disperse; returns false for anything else.
+bool Scene_SetDispersion(Scene *scene, Handle handle, f32 dispersion) {
+    Component *component = Scene_GetComponent(scene, handle);
+    if (!component || component->kind != COMPONENT_LENS) return false;
+
+    component->dispersion = dispersion;
+    Scene_MarkRegion(scene, &component->line);
+    scene->paraxial.stale = true;
+    return true;
+}
+
+bool Scene_RemoveComponent(Scene *scene, Handle handle) {
+    usize index;
+    if (!SlotMap_Remove(&scene->component_handles, handle, &index)) return false;
+
+    Component *component = scene->components.data + index;
+    Scene_MarkRegion(scene, &component->line);
+    Bvh_Remove(&scene->bvh, index, scene->components.length - 1);
+    scene->grid.stale = true;
+    scene->paraxial.stale = true;
+    *component = scene->components.data[--scene->components.length];
+    return true;
+}
+
+// Switches tracing lens runs by their matrices on or off. Paths through a run
+// move by rounding, so every ray is retraced.
+void Scene_SetParaxial(Scene *scene, bool enabled) {
+    if (scene->paraxial.enabled == enabled) return;
+    scene->paraxial.enabled = enabled;
+    for (usize i = 0; i < scene->light_rays.length; i++) {
+        *List_Push(&scene->changed_rays, &scene->arena) = i;
+    }
+}
+
+// Brings the accelerator in use, and the lens runs if they are on, up to date
+// with the components. Whichever are not in use catch up when they are
+// switched to.
+void Scene_UpdateAccelerator(Scene *scene) {
+    if (scene->accelerator == ACCELERATOR_BVH) Bvh_Update(&scene->bvh, &scene->components, &scene->arena);
+    if (scene->accelerator == ACCELERATOR_GRID) Grid_Update(&scene->grid, &scene->components, &scene->arena);
+    if (scene->paraxial.enabled) Paraxial_Update(&scene->paraxial, &scene->components, &scene->arena);
+}
+
+// Finds the nearest component hit by `ray` with the scene's accelerator,
+// which must be up to date.
+bool Scene_Closest(Scene *scene, Ray *ray, Hit *hit) {
+    switch (scene->accelerator) {
+        case ACCELERATOR_GRID: return Grid_Closest(&scene->grid, ray, hit);
+        case ACCELERATOR_BRUTE: return closest_component(ray, &scene->components, hit);
+        default: return Bvh_Closest(&scene->bvh, ray, hit);
+    }
+}
+
+// Scene_Closest for `count` rays heading about the same way. Only the BVH
+// traces them as a packet; the other accelerators take them one at a time.
+void Scene_ClosestPacket(Scene *scene, Ray **rays, u32 count, Hit *hits) {
+    if (scene->accelerator == ACCELERATOR_BVH) {
+        Bvh_ClosestPacket(&scene->bvh, rays, count, hits);
+        return;
+    }
+    for (u32 m = 0; m < count; m++) Scene_Closest(scene, rays[m], hits + m);
+}
+
+typedef enum {
+    SCENE_NONE,
+    SCENE_POINT_LIGHT,
+    SCENE_LINE_LIGHT,
+    SCENE_COMPONENT
+} SceneObjectKind;
+
+typedef struct {
+    SceneObjectKind kind;
+    Handle handle;
+} SceneObject;
+
+// The source or component closest to `point`, or SCENE_NONE if nothing is
+// within `radius` of it.
+SceneObject Scene_Pick(Scene *scene, Vector2 *point, f32 radius) {
+    SceneObject picked = { .kind = SCENE_NONE };
+    f32 closest = radius;
+
+    for (usize i = 0; i < scene->point_lights.length; i++) {
+        f32 distance = Vector2_Distance(point, &scene->point_lights.data[i].position);
+        if (distance > closest) continue;
+        closest = distance;
+        picked = (SceneObject) { SCENE_POINT_LIGHT, SlotMap_Handle(&scene->point_light_handles, i) };
+    }
+    for (usize i = 0; i < scene->line_lights.length; i++) {
+        f32 distance = Line_Distance(&scene->line_lights.data[i].line, point);
+        if (distance > closest) continue;
+        closest = distance;
+        picked = (SceneObject) { SCENE_LINE_LIGHT, SlotMap_Handle(&scene->line_light_handles, i) };
+    }
+    for (usize i = 0; i < scene->components.length; i++) {
+        f32 distance = Line_Distance(&scene->components.data[i].line, point);
+        if (distance > closest) continue;
+        closest = distance;
+        picked = (SceneObject) { SCENE_COMPONENT, SlotMap_Handle(&scene->component_handles, i) };
+    }
+
+    return picked;
+}
+
+// Moves `object` by `delta`. Returns false if its handle is stale.
+bool Scene_Translate(Scene *scene, SceneObject *object, Vector2 *delta) {
+    switch (object->kind) {
+        case SCENE_POINT_LIGHT: {
+            PointLight *point_light = Scene_GetPointLight(scene, object->handle);
+            if (!point_light) return false;
+            Vector2 position = Vector2_Add(&point_light->position, delta);
+            return Scene_MovePointLight(scene, object->handle, &position);
+        }
+        case SCENE_LINE_LIGHT: {
+            LineLight *line_light = Scene_GetLineLight(scene, object->handle);
+            if (!line_light) return false;
+            Line line = {
+                Vector2_Add(&line_light->line.start, delta),
+                Vector2_Add(&line_light->line.end, delta)
+            };
+            return Scene_MoveLineLight(scene, object->handle, &line);
+        }
+        case SCENE_COMPONENT: {
+            Component *component = Scene_GetComponent(scene, object->handle);
+            if (!component) return false;
+            Line line = {
+                Vector2_Add(&component->line.start, delta),
+                Vector2_Add(&component->line.end, delta)
+            };
+            return Scene_MoveComponent(scene, object->handle, &line);
+        }
+        default:
+            return false;
+    }
+}
+
+bool Scene_Remove(Scene *scene, SceneObject *object) {
+    switch (object->kind) {
+        case SCENE_POINT_LIGHT: return Scene_RemovePointLight(scene, object->handle);
+        case SCENE_LINE_LIGHT: return Scene_RemoveLineLight(scene, object->handle);
+        case SCENE_COMPONENT: return Scene_RemoveComponent(scene, object->handle);
+        default: return false;
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/mapping.c"
+#include "constants.c"
+#include "lines.c"
+#include "lights.c"
+#include "components.c"
+#include "scene.c"
+
+// Binary scene files: a header followed by packed arrays of bare rays,
+// components, point light positions and line light lines. Rays and components
+// are stored as the exact structs the tracer uses, each array starting at an
+// aligned offset, so Scene_Load maps the file and points the scene's lists
+// straight at it without parsing anything. Sources are few and own ray slots
+// and handles, so they are re-added through the Scene_* functions instead.
+//
+// The files are native-endian and tied to the struct layouts of the build
+// that wrote them; `ray_size` and `component_size` catch the layout changing,
+// and SCENE_FILE_VERSION must be bumped whenever the format itself does.
+
+typedef struct {
+    u64 offset;
+    u64 count;
+} SceneFileArray;
+
+typedef struct {
+    char magic[4];
+    u32 version;
+    u32 ray_size;
+    u32 component_size;
+    TraceOptions options;
+    SceneFileArray rays;
+    SceneFileArray components;
+    SceneFileArray point_lights;
+    SceneFileArray line_lights;
+} SceneFileHeader;
+
+static const char SCENE_FILE_MAGIC[4] = { 'S', 'L', 'S', 'C' };
+
+// Where an array of `count` elements of `size` bytes goes after `*offset`.
+static SceneFileArray SceneFile_Place(u64 *offset, usize size, usize count) {
+    *offset = (*offset + SCENE_FILE_ALIGN - 1) / SCENE_FILE_ALIGN * SCENE_FILE_ALIGN;
+    SceneFileArray array = { .offset = *offset, .count = count };
+    *offset += size * count;
+    return array;
+}
+
+static bool SceneFile_Write(FILE *file, SceneFileArray *array, void *data, usize size) {
+    // an empty list may have no data at all
+    if (array->count == 0) return true;
+    if (fseek(file, array->offset, SEEK_SET) != 0) return false;
+    return fwrite(data, size, array->count, file) == array->count;
+}
+
+// Whether `array` lies inside a file of `size` bytes and is aligned for
+// direct use. Nothing is written for an empty array, so the file may end
+// before its offset.
+static bool SceneFile_Valid(SceneFileArray *array, usize element_size, usize size) {
+    if (array->count == 0) return true;
+    if (array->offset % SCENE_FILE_ALIGN != 0 || array->offset > size) return false;
+    return array->count <= (size - array->offset) / element_size;
+}
+
+// Writes `scene` to `path`. Only bare rays are stored; the rays of sources
+// are emitted again on load. Returns false if the file can't be written.
+bool Scene_Save(Scene *scene, char *path, Arena *scratch) {
+    // rays owned by a source, or free (zero intensity), are not bare
+    bool *owned = Arena_Alloc(scratch, bool, scene->light_rays.length);
+    memset(owned, 0, scene->light_rays.length * sizeof(bool));
+    for (usize i = 0; i < scene->point_lights.length; i++) {
+        usize *ray_indices = scene->point_lights.data[i].ray_indices;
+        for (usize k = 0; k < POINT_SOURCE_RAY_NUMBER; k++) owned[ray_indices[k]] = true;
+    }
+    for (usize i = 0; i < scene->line_lights.length; i++) {
+        LineLight *line_light = scene->line_lights.data + i;
+        for (u32 k = 0; k < line_light->ray_count; k++) owned[line_light->ray_indices[k]] = true;
+    }
+
+    Rays rays = { 0 };
+    for (usize i = 0; i < scene->light_rays.length; i++) {
+        Ray *ray = scene->light_rays.data + i;
+        if (!owned[i] && ray->intensity > 0) *List_Push(&rays, scratch) = *ray;
+    }
+    Vector2 *positions = Arena_Alloc(scratch, Vector2, scene->point_lights.length);
+    for (usize i = 0; i < scene->point_lights.length; i++) positions[i] = scene->point_lights.data[i].position;
+    Line *lines = Arena_Alloc(scratch, Line, scene->line_lights.length);
+    for (usize i = 0; i < scene->line_lights.length; i++) lines[i] = scene->line_lights.data[i].line;
+
+    u64 offset = sizeof(SceneFileHeader);
+    SceneFileHeader header = {
+        .version = SCENE_FILE_VERSION,
+        .ray_size = sizeof(Ray),
+        .component_size = sizeof(Component),
+        .options = scene->options,
+        .rays = SceneFile_Place(&offset, sizeof(Ray), rays.length),
+        .components = SceneFile_Place(&offset, sizeof(Component), scene->components.length),
+        .point_lights = SceneFile_Place(&offset, sizeof(Vector2), scene->point_lights.length),
+        .line_lights = SceneFile_Place(&offset, sizeof(Line), scene->line_lights.length)
+    };
+    memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+
+    // Truncating `path` would pull the pages out from under any scene still
+    // mapped from it, so write a new file and rename it over the old one.
+    usize length = strlen(path);
+    char *temporary = Arena_Alloc(scratch, char, length + 5);
+    memcpy(temporary, path, length);
+    memcpy(temporary + length, ".tmp", 5);
+
+    FILE *file = fopen(temporary, "wb");
+    if (!file) return false;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && SceneFile_Write(file, &header.rays, rays.data, sizeof(Ray))
+        && SceneFile_Write(file, &header.components, scene->components.data, sizeof(Component))
+        && SceneFile_Write(file, &header.point_lights, positions, sizeof(Vector2))
+        && SceneFile_Write(file, &header.line_lights, lines, sizeof(Line));
+    // fclose flushes, so it can fail too
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporary, path) != 0) {
+        remove(temporary);
+        return false;
+    }
+    return true;
+}
+
+// Loads the file at `path` into `scene`, which must be new. Returns false,
+// leaving `scene` untouched, if the file is missing or not a scene file this
+// build can read.
+bool Scene_Load(Scene *scene, char *path) {
+    Mapping mapping;
+    if (!Mapping_Open(&mapping, path)) return false;
+
+    SceneFileHeader *header = mapping.data;
+    bool valid = mapping.size >= sizeof(SceneFileHeader)
+        && memcmp(header->magic, SCENE_FILE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == SCENE_FILE_VERSION
+        && header->ray_size == sizeof(Ray)
+        && header->component_size == sizeof(Component)
+        && SceneFile_Valid(&header->rays, sizeof(Ray), mapping.size)
+        && SceneFile_Valid(&header->components, sizeof(Component), mapping.size)
+        && SceneFile_Valid(&header->point_lights, sizeof(Vector2), mapping.size)
+        && SceneFile_Valid(&header->line_lights, sizeof(Line), mapping.size);
+    if (!valid) {
+        Mapping_Close(&mapping);
+        return false;
+    }
+
+    u8 *data = mapping.data;
+    scene->mapping = mapping;
+    scene->options = header->options;
+    // capacity == length, so the first push copies the list into the arena
+    scene->light_rays = (Rays) {
+        .data = (Ray *) (data + header->rays.offset),
+        .length = header->rays.count,
+        .capacity = header->rays.count
+    };
+    scene->components = (Components) {
+        .data = (Component *) (data + header->components.offset),
+        .length = header->components.count,
+        .capacity = header->components.count
+    };
+    SlotMap *handles = &scene->component_handles;
+    List_Reserve(&handles->slots, scene->components.length, &scene->arena);
+    List_Reserve(&handles->owners, scene->components.length, &scene->arena);
+    for (usize i = 0; i < scene->components.length; i++) SlotMap_Insert(handles, &scene->arena);
+
+    Vector2 *positions = (Vector2 *) (data + header->point_lights.offset);
+    for (usize i = 0; i < header->point_lights.count; i++) Scene_AddPointLight(scene, positions + i);
+    Line *lines = (Line *) (data + header->line_lights.offset);
+    for (usize i = 0; i < header->line_lights.count; i++) Scene_AddLineLight(scene, lines + i);
+
+    return true;
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <float.h>
+#include <math.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/vectors.c"
+#include "constants.c"
+#include "lines.c"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEGMENTS_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SEGMENTS_NEON
+#endif
+
+// Structure-of-arrays copy of a list of line segments, laid out so one ray can
+// be tested against several segments at once. Every array is padded with
+// SEGMENTS_WIDTH zeroed entries past `length` so kernels can always load whole
+// vectors; zero-length segments never count as a hit.
+
+#define SEGMENTS_WIDTH 8
+
+typedef struct {
+    f32 *x;
+    f32 *y;
+    f32 *dx;
+    f32 *dy;
+    usize length;
+    usize capacity;
+} Segments;
+
+// Finds the closest segment in [first, first + count) hit by the ray, if it
+// is closer than `*distance`. Returns its index and updates `*distance`, or
+// returns -1 and leaves `*distance` alone.
+typedef usize (*SegmentsKernel)(Segments *segments, usize first, usize count, Vector2 *start, Vector2 *direction, f32 *distance);
+
+void Segments_Resize(Segments *segments, usize length, Arena *arena) {
+    // an empty list still needs its padding, for the kernels to read
+    if (length > segments->capacity || !segments->x) {
+        // grow geometrically so a scene built one component at a time does
+        // not reallocate on every rebuild
+        usize capacity = 2 * length + SEGMENTS_WIDTH;
+        segments->x = Arena_AllocAlign(arena, sizeof(f32), 32, capacity, 0);
+        segments->y = Arena_AllocAlign(arena, sizeof(f32), 32, capacity, 0);
+        segments->dx = Arena_AllocAlign(arena, sizeof(f32), 32, capacity, 0);
+        segments->dy = Arena_AllocAlign(arena, sizeof(f32), 32, capacity, 0);
+        segments->capacity = 2 * length;
+    }
+
+    // clear the padding and anything left over from a longer list
+    usize stale = segments->capacity + SEGMENTS_WIDTH - length;
+    memset(segments->x + length, 0, stale * sizeof(f32));
+    memset(segments->y + length, 0, stale * sizeof(f32));
+    memset(segments->dx + length, 0, stale * sizeof(f32));
+    memset(segments->dy + length, 0, stale * sizeof(f32));
+    segments->length = length;
+}
+
+void Segments_Set(Segments *segments, usize index, Line *line) {
+    if (index < 0 || index >= segments->length) { raise(SIGTRAP); }
+    segments->x[index] = line->start.x;
+    segments->y[index] = line->start.y;
+    segments->dx[index] = line->end.x - line->start.x;
+    segments->dy[index] = line->end.y - line->start.y;
+}
+
+static usize segments_closest_scalar(Segments *segments, usize first, usize count, Vector2 *start, Vector2 *direction, f32 *distance) {
+    usize index = (usize) -1;
+    for (usize i = first; i < first + count; i++) {
+        Line line = {
+            .start = { segments->x[i], segments->y[i] },
+            .end = { segments->x[i] + segments->dx[i], segments->y[i] + segments->dy[i] }
+        };
+
+        f32 test_distance = ray_line_distance(start, direction, &line);
+        if (test_distance < *distance) {
+            *distance = test_distance;
+            index = i;
+        }
+    }
+
+    return index;
+}
+
+#if defined(SEGMENTS_X86) || defined(SEGMENTS_NEON)
+// Picks the nearest lane out of a kernel's per-lane results, preferring the
+// lowest index on ties so every kernel agrees with the scalar one.
+static usize segments_reduce(f32 *lane_distances, i32 *lane_indices, usize lanes, usize first, f32 *distance) {
+    usize index = (usize) -1;
+    for (usize i = 0; i < lanes; i++) {
+        if (lane_indices[i] < 0) continue;
+        if (lane_distances[i] < *distance || (lane_distances[i] == *distance && first + lane_indices[i] < index)) {
+            *distance = lane_distances[i];
+            index = first + lane_indices[i];
+        }
+    }
+
+    return index;
+}
+#endif
+
+#ifdef SEGMENTS_X86
+static usize segments_closest_sse(Segments *segments, usize first, usize count, Vector2 *start, Vector2 *direction, f32 *distance) {
+    __m128 start_x = _mm_set1_ps(start->x), start_y = _mm_set1_ps(start->y);
+    __m128 ray_x = _mm_set1_ps(direction->x), ray_y = _mm_set1_ps(direction->y);
+    __m128 epsilon = _mm_set1_ps(EPSILON), upper = _mm_set1_ps(1.0f - EPSILON);
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+    __m128i limit = _mm_set1_epi32((i32) count);
+
+    __m128 best_distance = _mm_set1_ps(*distance);
+    __m128i best_index = _mm_set1_epi32(-1);
+
+    for (usize i = 0; i < count; i += 4) {
+        __m128 separation_x = _mm_sub_ps(_mm_loadu_ps(segments->x + first + i), start_x);
+        __m128 separation_y = _mm_sub_ps(_mm_loadu_ps(segments->y + first + i), start_y);
+        __m128 dx = _mm_loadu_ps(segments->dx + first + i);
+        __m128 dy = _mm_loadu_ps(segments->dy + first + i);
+
+        __m128 denominator = _mm_sub_ps(_mm_mul_ps(ray_x, dy), _mm_mul_ps(ray_y, dx));
+        __m128 t_1 = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(separation_x, dy), _mm_mul_ps(separation_y, dx)), denominator);
+        __m128 t_2 = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(separation_x, ray_y), _mm_mul_ps(separation_y, ray_x)), denominator);
+
+        __m128i index = _mm_add_epi32(lanes, _mm_set1_epi32((i32) i));
+        __m128 hit = _mm_cmpge_ps(_mm_andnot_ps(sign, denominator), epsilon);
+        hit = _mm_and_ps(hit, _mm_cmpgt_ps(t_1, epsilon));
+        hit = _mm_and_ps(hit, _mm_cmpgt_ps(t_2, epsilon));
+        hit = _mm_and_ps(hit, _mm_cmplt_ps(t_2, upper));
+        hit = _mm_and_ps(hit, _mm_cmplt_ps(t_1, best_distance));
+        hit = _mm_and_ps(hit, _mm_castsi128_ps(_mm_cmplt_epi32(index, limit)));
+
+        best_distance = _mm_or_ps(_mm_and_ps(hit, t_1), _mm_andnot_ps(hit, best_distance));
+        best_index = _mm_castps_si128(_mm_or_ps(
+            _mm_and_ps(hit, _mm_castsi128_ps(index)),
+            _mm_andnot_ps(hit, _mm_castsi128_ps(best_index))
+        ));
+    }
+
+    f32 lane_distances[4];
+    i32 lane_indices[4];
+    _mm_storeu_ps(lane_distances, best_distance);
+    _mm_storeu_si128((__m128i *) lane_indices, best_index);
+    return segments_reduce(lane_distances, lane_indices, 4, first, distance);
+}
+
+__attribute__((target("avx2")))
+static usize segments_closest_avx2(Segments *segments, usize first, usize count, Vector2 *start, Vector2 *direction, f32 *distance) {
+    __m256 start_x = _mm256_set1_ps(start->x), start_y = _mm256_set1_ps(start->y);
+    __m256 ray_x = _mm256_set1_ps(direction->x), ray_y = _mm256_set1_ps(direction->y);
+    __m256 epsilon = _mm256_set1_ps(EPSILON), upper = _mm256_set1_ps(1.0f - EPSILON);
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i limit = _mm256_set1_epi32((i32) count);
+
+    __m256 best_distance = _mm256_set1_ps(*distance);
+    __m256i best_index = _mm256_set1_epi32(-1);
+
+    for (usize i = 0; i < count; i += 8) {
+        __m256 separation_x = _mm256_sub_ps(_mm256_loadu_ps(segments->x + first + i), start_x);
+        __m256 separation_y = _mm256_sub_ps(_mm256_loadu_ps(segments->y + first + i), start_y);
+        __m256 dx = _mm256_loadu_ps(segments->dx + first + i);
+        __m256 dy = _mm256_loadu_ps(segments->dy + first + i);
+
+        __m256 denominator = _mm256_sub_ps(_mm256_mul_ps(ray_x, dy), _mm256_mul_ps(ray_y, dx));
+        __m256 t_1 = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(separation_x, dy), _mm256_mul_ps(separation_y, dx)), denominator);
+        __m256 t_2 = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(separation_x, ray_y), _mm256_mul_ps(separation_y, ray_x)), denominator);
+
+        __m256i index = _mm256_add_epi32(lanes, _mm256_set1_epi32((i32) i));
+        __m256 hit = _mm256_cmp_ps(_mm256_andnot_ps(sign, denominator), epsilon, _CMP_GE_OQ);
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(t_1, epsilon, _CMP_GT_OQ));
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(t_2, epsilon, _CMP_GT_OQ));
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(t_2, upper, _CMP_LT_OQ));
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(t_1, best_distance, _CMP_LT_OQ));
+        hit = _mm256_and_ps(hit, _mm256_castsi256_ps(_mm256_cmpgt_epi32(limit, index)));
+
+        best_distance = _mm256_blendv_ps(best_distance, t_1, hit);
+        best_index = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(best_index), _mm256_castsi256_ps(index), hit));
+    }
+
+    f32 lane_distances[8];
+    i32 lane_indices[8];
+    _mm256_storeu_ps(lane_distances, best_distance);
+    _mm256_storeu_si256((__m256i *) lane_indices, best_index);
+    return segments_reduce(lane_distances, lane_indices, 8, first, distance);
+}
+#endif
+
+#ifdef SEGMENTS_NEON
+static usize segments_closest_neon(Segments *segments, usize first, usize count, Vector2 *start, Vector2 *direction, f32 *distance) {
+    float32x4_t start_x = vdupq_n_f32(start->x), start_y = vdupq_n_f32(start->y);
+    float32x4_t ray_x = vdupq_n_f32(direction->x), ray_y = vdupq_n_f32(direction->y);
+    float32x4_t epsilon = vdupq_n_f32(EPSILON), upper = vdupq_n_f32(1.0f - EPSILON);
+    int32x4_t lanes = { 0, 1, 2, 3 };
+    int32x4_t limit = vdupq_n_s32((i32) count);
+
+    float32x4_t best_distance = vdupq_n_f32(*distance);
+    int32x4_t best_index = vdupq_n_s32(-1);
+
+    for (usize i = 0; i < count; i += 4) {
+        float32x4_t separation_x = vsubq_f32(vld1q_f32(segments->x + first + i), start_x);
+        float32x4_t separation_y = vsubq_f32(vld1q_f32(segments->y + first + i), start_y);
+        float32x4_t dx = vld1q_f32(segments->dx + first + i);
+        float32x4_t dy = vld1q_f32(segments->dy + first + i);
+
+        float32x4_t denominator = vsubq_f32(vmulq_f32(ray_x, dy), vmulq_f32(ray_y, dx));
+        float32x4_t t_1 = vdivq_f32(vsubq_f32(vmulq_f32(separation_x, dy), vmulq_f32(separation_y, dx)), denominator);
+        float32x4_t t_2 = vdivq_f32(vsubq_f32(vmulq_f32(separation_x, ray_y), vmulq_f32(separation_y, ray_x)), denominator);
+
+        int32x4_t index = vaddq_s32(lanes, vdupq_n_s32((i32) i));
+        uint32x4_t hit = vcgeq_f32(vabsq_f32(denominator), epsilon);
+        hit = vandq_u32(hit, vcgtq_f32(t_1, epsilon));
+        hit = vandq_u32(hit, vcgtq_f32(t_2, epsilon));
+        hit = vandq_u32(hit, vcltq_f32(t_2, upper));
+        hit = vandq_u32(hit, vcltq_f32(t_1, best_distance));
+        hit = vandq_u32(hit, vcltq_s32(index, limit));
+
+        best_distance = vbslq_f32(hit, t_1, best_distance);
+        best_index = vbslq_s32(hit, index, best_index);
+    }
+
+    f32 lane_distances[4];
+    i32 lane_indices[4];
+    vst1q_f32(lane_distances, best_distance);
+    vst1q_s32(lane_indices, best_index);
+    return segments_reduce(lane_distances, lane_indices, 4, first, distance);
+}
+#endif
+
+// Widest kernel the running CPU supports, picked once.
+SegmentsKernel Segments_Kernel() {
+    static SegmentsKernel kernel = NULL;
+    if (kernel) return kernel;
+
+    kernel = segments_closest_scalar;
+#if defined(SEGMENTS_X86)
+    kernel = __builtin_cpu_supports("avx2") ? segments_closest_avx2 : segments_closest_sse;
+#elif defined(SEGMENTS_NEON)
+    kernel = segments_closest_neon;
+#endif
+    return kernel;
+}
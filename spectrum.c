@@ -0,0 +1,31 @@
+#pragma once
+
+#include <math.h>
+
+#include "lib/types.c"
+#include "lib/raylib.c"
+#include "constants.c"
+
+// Rays start out white, carrying the whole visible spectrum as one ray. At
+// the first dispersive lens a white ray splits into SPECTRUM_SAMPLES rays of
+// one wavelength each, sampled at the centers of equal bins over
+// [SPECTRUM_MIN, SPECTRUM_MAX], so a scene only pays for the extra rays where
+// wavelengths actually part ways.
+
+// Wavelength of the `index`th sample.
+f32 Spectrum_Sample(u32 index) {
+    return SPECTRUM_MIN + (SPECTRUM_MAX - SPECTRUM_MIN) * (index + 0.5f) / SPECTRUM_SAMPLES;
+}
+
+// Linear RGB weights of light at `wavelength`. Blue fades out over the lower
+// half of the range, red fades in over the upper half and green takes the
+// rest. Each channel is scaled to average 1 over the range, and the ramps are
+// linear within every sample bin, so the samples of a white ray add back up
+// to exactly white. A white ray is (1, 1, 1).
+Vector3 Spectrum_Color(f32 wavelength) {
+    if (wavelength == 0) return (Vector3) { 1, 1, 1 };
+    f32 x = fminf(fmaxf((wavelength - SPECTRUM_MIN) / (SPECTRUM_MAX - SPECTRUM_MIN), 0), 1);
+    f32 blue = fmaxf(0, 1 - 2 * x);
+    f32 red = fmaxf(0, 2 * x - 1);
+    return (Vector3) { 4 * red, 2 * (1 - red - blue), 4 * blue };
+}
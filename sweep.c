@@ -0,0 +1,307 @@
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/slotmap.c"
+#include "lib/threads.c"
+#include "lib/vectors.c"
+#include "constants.c"
+#include "lines.c"
+#include "scene.c"
+#include "scenefile.c"
+#include "trace.c"
+#include "tests.c"
+
+// Parameter sweeps. A sweep takes a scene and ranges for some of its
+// parameters (focal lengths, component endpoints, source positions), traces
+// every combination of them and ranks the variants by how tightly their rays
+// cross a target line: the intensity-weighted RMS distance of the crossings
+// from their center, along the target.
+//
+// The variants are spread over a thread pool. Each worker loads its own copy
+// of the scene once and then moves it from variant to variant through the
+// Scene_* setters, which set values rather than add to them, so a variant
+// comes out the same whichever worker traces it and whatever it traced
+// before. Each worker traces into its own arena, reset between variants with
+// the output list reserved at the size of the last one, so once the first
+// few variants have been traced a variant allocates nothing.
+
+typedef enum {
+    SWEEP_FOCAL_LENGTH,
+    SWEEP_START,
+    SWEEP_END,
+    SWEEP_POINT_LIGHT,
+    SWEEP_LINE_LIGHT,
+    SWEEP_KIND_COUNT
+} SweepKind;
+
+char *const SWEEP_KIND_NAMES[SWEEP_KIND_COUNT] = { "focal", "start", "end", "point", "line" };
+
+// A parameter takes `steps` evenly spaced values from `from` to `to`. A focal
+// length only uses x. `index` is the component's or the light's place in its
+// list, and a line light keeps its length and direction as its start moves.
+typedef struct {
+    SweepKind kind;
+    usize index;
+    Vector2 from;
+    Vector2 to;
+    u32 steps;
+    Vector2 extent;
+} SweepParameter;
+
+typedef struct {
+    SweepParameter *data;
+    usize length;
+    usize capacity;
+} SweepParameters;
+
+typedef struct {
+    u32 variant;
+    u32 hits;
+    f32 intensity;
+    // along the target from its start, in pixels
+    f32 center;
+    f32 spot;
+    usize segments;
+} SweepResult;
+
+typedef struct {
+    Scene scene;
+    Arena frame;
+    LightLines light_lines;
+    TraceStats stats;
+} SweepWorker;
+
+typedef struct {
+    ThreadPool pool;
+    SweepWorker *workers;
+    Arena arena;
+    SweepParameters parameters;
+    Line target;
+    usize variant_count;
+    // ranked, best first, after a run
+    SweepResult *results;
+} Sweep;
+
+void Sweep_Init(Sweep *sweep, usize workers, Line *target, Arena *arena) {
+    *sweep = (Sweep) {
+        .arena = Arena_New(SWEEP_ARENA_CAPACITY),
+        .target = *target,
+        .variant_count = 1
+    };
+    ThreadPool_Init(&sweep->pool, workers, arena);
+    sweep->workers = Arena_Alloc(arena, SweepWorker, sweep->pool.count);
+    for (usize i = 0; i < sweep->pool.count; i++) sweep->workers[i].scene = Scene_New();
+
+    // pick the kernel up front instead of racing on it from the workers
+    Segments_Kernel();
+}
+
+void Sweep_Free(Sweep *sweep) {
+    ThreadPool_Free(&sweep->pool);
+    for (usize i = 0; i < sweep->pool.count; i++) {
+        Scene_Free(&sweep->workers[i].scene);
+        Arena_Free(&sweep->workers[i].frame);
+    }
+    Arena_Free(&sweep->arena);
+}
+
+// Loads a copy of the scene for every worker, by the name of a scene in
+// tests.c or the path of a scene file. Returns false if there is no such
+// scene.
+bool Sweep_Load(Sweep *sweep, char *name) {
+    for (usize i = 0; i < sweep->pool.count; i++) {
+        Scene *scene = &sweep->workers[i].scene;
+        if (!test_load(scene, name) && !Scene_Load(scene, name)) return false;
+    }
+    return true;
+}
+
+// Parses `kind:index:from:to:steps`, where `from` and `to` are `x,y` points
+// or, for a focal length, single numbers. For example `focal:0:200:400:9` or
+// `point:1:100,300:100,500:5`.
+bool SweepParameter_Parse(char *text, SweepParameter *parameter) {
+    *parameter = (SweepParameter) { 0 };
+    char *colon = strchr(text, ':');
+    if (!colon) return false;
+    usize length = colon - text;
+    while (parameter->kind < SWEEP_KIND_COUNT) {
+        char *name = SWEEP_KIND_NAMES[parameter->kind];
+        if (strlen(name) == length && strncmp(name, text, length) == 0) break;
+        parameter->kind++;
+    }
+
+    i32 consumed = 0;
+    if (parameter->kind == SWEEP_FOCAL_LENGTH) {
+        sscanf(colon, ":%zu:%f:%f:%u%n", &parameter->index, &parameter->from.x, &parameter->to.x, &parameter->steps, &consumed);
+    } else if (parameter->kind < SWEEP_KIND_COUNT) {
+        sscanf(colon, ":%zu:%f,%f:%f,%f:%u%n", &parameter->index, &parameter->from.x, &parameter->from.y,
+            &parameter->to.x, &parameter->to.y, &parameter->steps, &consumed);
+    }
+    return consumed > 0 && colon[consumed] == '\0' && parameter->steps > 0;
+}
+
+// Adds a parameter to sweep once the scene is loaded. Returns false if the
+// scene has nothing it could apply to, or if it would make too many variants.
+bool Sweep_AddParameter(Sweep *sweep, SweepParameter *parameter) {
+    Scene *scene = &sweep->workers[0].scene;
+    switch (parameter->kind) {
+        case SWEEP_FOCAL_LENGTH:
+            if (parameter->index >= scene->components.length) return false;
+            if (scene->components.data[parameter->index].kind != COMPONENT_LENS) return false;
+            break;
+        case SWEEP_START:
+        case SWEEP_END:
+            if (parameter->index >= scene->components.length) return false;
+            break;
+        case SWEEP_POINT_LIGHT:
+            if (parameter->index >= scene->point_lights.length) return false;
+            break;
+        case SWEEP_LINE_LIGHT: {
+            if (parameter->index >= scene->line_lights.length) return false;
+            Line *line = &scene->line_lights.data[parameter->index].line;
+            parameter->extent = Vector2_Subtract(&line->end, &line->start);
+            break;
+        }
+        default:
+            return false;
+    }
+    if (sweep->variant_count * parameter->steps > SWEEP_MAX_VARIANTS) return false;
+
+    sweep->variant_count *= parameter->steps;
+    *List_Push(&sweep->parameters, &sweep->arena) = *parameter;
+    return true;
+}
+
+// The value of the `parameter`th parameter in `variant`. The first parameter
+// changes slowest.
+Vector2 Sweep_Value(Sweep *sweep, usize variant, usize parameter) {
+    for (usize i = sweep->parameters.length - 1; i > parameter; i--) variant /= sweep->parameters.data[i].steps;
+    SweepParameter *swept = sweep->parameters.data + parameter;
+    f32 t = swept->steps > 1 ? (f32) (variant % swept->steps) / (swept->steps - 1) : 0;
+    return (Vector2) {
+        swept->from.x + (swept->to.x - swept->from.x) * t,
+        swept->from.y + (swept->to.y - swept->from.y) * t
+    };
+}
+
+static void Sweep_Apply(Scene *scene, SweepParameter *parameter, Vector2 value) {
+    switch (parameter->kind) {
+        case SWEEP_FOCAL_LENGTH:
+            Scene_SetFocalLength(scene, SlotMap_Handle(&scene->component_handles, parameter->index), value.x);
+            break;
+        case SWEEP_START:
+        case SWEEP_END: {
+            Line line = scene->components.data[parameter->index].line;
+            if (parameter->kind == SWEEP_START) line.start = value;
+            else line.end = value;
+            Scene_MoveComponent(scene, SlotMap_Handle(&scene->component_handles, parameter->index), &line);
+            break;
+        }
+        case SWEEP_POINT_LIGHT:
+            Scene_MovePointLight(scene, SlotMap_Handle(&scene->point_light_handles, parameter->index), &value);
+            break;
+        case SWEEP_LINE_LIGHT: {
+            Line line = { value, Vector2_Add(&value, &parameter->extent) };
+            Scene_MoveLineLight(scene, SlotMap_Handle(&scene->line_light_handles, parameter->index), &line);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Where the segments cross the target and how far apart.
+static void Sweep_Score(Line *target, LightLines *light_lines, SweepResult *result) {
+    Vector2 delta = Vector2_Subtract(&target->end, &target->start);
+    Vector2 direction = Vector2_Normalize(&delta);
+    f64 weight = 0, sum = 0, square_sum = 0;
+    for (usize i = 0; i < light_lines->length; i++) {
+        LightLine *light_line = light_lines->data + i;
+        Vector2 point = lines_intersect(&light_line->line, target);
+        if (isnan(point.x)) continue;
+
+        Vector2 offset = Vector2_Subtract(&point, &target->start);
+        f64 along = Vector2_Dot(&offset, &direction);
+        result->hits++;
+        weight += light_line->intensity;
+        sum += light_line->intensity * along;
+        square_sum += light_line->intensity * along * along;
+    }
+
+    result->intensity = weight;
+    result->center = weight > 0 ? sum / weight : NAN;
+    result->spot = INFINITY;
+    if (result->hits >= SWEEP_MIN_HITS && weight > 0) {
+        f64 mean = sum / weight;
+        result->spot = sqrt(fmax(square_sum / weight - mean * mean, 0));
+    }
+}
+
+static void Sweep_TraceVariant(void *context, usize variant, usize worker) {
+    Sweep *sweep = context;
+    SweepWorker *sweep_worker = sweep->workers + worker;
+    Scene *scene = &sweep_worker->scene;
+    for (usize i = 0; i < sweep->parameters.length; i++) {
+        Sweep_Apply(scene, sweep->parameters.data + i, Sweep_Value(sweep, variant, i));
+    }
+    // nothing picks up the edits but the accelerator, so their log is dropped
+    scene->changed_rays.length = 0;
+    scene->changed_regions.length = 0;
+
+    usize capacity = sweep_worker->light_lines.capacity;
+    Arena_Reset(&sweep_worker->frame);
+    sweep_worker->light_lines = (LightLines) { 0 };
+    List_Reserve(&sweep_worker->light_lines, capacity, &sweep_worker->frame);
+    trace_scene(scene, &sweep_worker->light_lines, &sweep_worker->stats, &sweep_worker->frame);
+
+    SweepResult *result = sweep->results + variant;
+    *result = (SweepResult) { .variant = variant, .segments = sweep_worker->light_lines.length };
+    Sweep_Score(&sweep->target, &sweep_worker->light_lines, result);
+}
+
+// Tightest spot first, then brightest, then in variant order, so the ranking
+// does not depend on the scheduling.
+static int SweepResult_Compare(const void *a, const void *b) {
+    const SweepResult *x = a, *y = b;
+    if (x->spot != y->spot) return x->spot < y->spot ? -1 : 1;
+    if (x->intensity != y->intensity) return x->intensity > y->intensity ? -1 : 1;
+    return (x->variant > y->variant) - (x->variant < y->variant);
+}
+
+// Traces and scores every variant, then ranks them into `results`.
+void Sweep_Run(Sweep *sweep) {
+    sweep->results = Arena_Alloc(&sweep->arena, SweepResult, sweep->variant_count);
+    ThreadPool_Run(&sweep->pool, sweep->variant_count, Sweep_TraceVariant, sweep);
+    qsort(sweep->results, sweep->variant_count, sizeof(SweepResult), SweepResult_Compare);
+}
+
+// Writes the `top` best variants as a table, or every variant if `top` is 0.
+void Sweep_Print(Sweep *sweep, usize top, FILE *file) {
+    usize count = top > 0 && top < sweep->variant_count ? top : sweep->variant_count;
+    fprintf(file, "%5s %8s", "rank", "variant");
+    for (usize i = 0; i < sweep->parameters.length; i++) {
+        SweepParameter *parameter = sweep->parameters.data + i;
+        char name[32];
+        snprintf(name, sizeof(name), "%s %zu", SWEEP_KIND_NAMES[parameter->kind], parameter->index);
+        fprintf(file, " %16s", name);
+    }
+    fprintf(file, " %6s %10s %9s %9s\n", "hits", "intensity", "center", "spot");
+
+    for (usize rank = 0; rank < count; rank++) {
+        SweepResult *result = sweep->results + rank;
+        fprintf(file, "%5zu %8u", rank + 1, result->variant);
+        for (usize i = 0; i < sweep->parameters.length; i++) {
+            Vector2 value = Sweep_Value(sweep, result->variant, i);
+            if (sweep->parameters.data[i].kind == SWEEP_FOCAL_LENGTH) fprintf(file, " %16.2f", value.x);
+            else fprintf(file, "  %7.1f,%7.1f", value.x, value.y);
+        }
+        fprintf(file, " %6u %10.3f %9.2f %9.3f\n", result->hits, result->intensity, result->center, result->spot);
+    }
+}
@@ -1,83 +1,232 @@
 #pragma once
 
+#include <stdbool.h>
+#include <string.h>
+
 #include "lib/arena.c"
 #include "lib/list.c"
+#include "lib/random.c"
 #include "optics.c"
+#include "components.c"
 #include "lights.c"
+#include "trace.c"
+#include "scene.c"
 
-void test_mirror(Rays *light_rays, Lines *mirrors, Arena *arena) {
-    *List_Push(light_rays, arena) = (Ray) {
-        .start = { 500, 500 },
-        .angle = -1
-    };
+void test_mirror(Scene *scene) {
+    *List_Push(&scene->light_rays, &scene->arena) = Ray_FromAngle((Vector2) { 500, 500 }, -1);
 
-    *List_Push(mirrors, arena) = (Line) {
+    Scene_AddMirror(scene, &(Line) {
         .start = { 700, 100 },
         .end = { 800, 100 }
-    };
+    });
 }
 
-void test_lens(Rays *light_rays, Lenses *lenses, Arena *arena) {
+void test_lens(Scene *scene) {
     i32 num_rays = 11;
     for (i32 i = 0; i < num_rays; i++) {
-        *List_Push(light_rays, arena) = (Ray) {
-            .start = {
-                200,
-                150 + 50 * i
-            },
-            .angle = 0.0
-        };
+        *List_Push(&scene->light_rays, &scene->arena) = Ray_FromAngle((Vector2) { 200, 150 + 50 * i }, 0.0);
+    }
+
+    Scene_AddLens(scene, &(Line) {
+        .start = { 500, 100 },
+        .end = { 500, 700 }
+    }, 300);
+}
+
+void test_lens_2(Scene *scene) {
+    *List_Push(&scene->light_rays, &scene->arena) = Ray_FromAngle((Vector2) { 200, 200 }, 0);
+
+    Scene_AddLens(scene, &(Line) {
+        .start = { 500, 100 },
+        .end = { 500, 700 }
+    }, 300);
+
+    Scene_AddLens(scene, &(Line) {
+        .start = { 700, 100 },
+        .end = { 700, 700 }
+    }, 300);
+}
+
+// A collimated beam through a dispersive lens, which splits it into colors
+// that focus at different distances, then on through a second dispersive lens
+// and off a mirror.
+void test_dispersion(Scene *scene) {
+    for (i32 i = 0; i < 9; i++) {
+        *List_Push(&scene->light_rays, &scene->arena) = Ray_FromAngle((Vector2) { 100, 200 + 50 * i }, 0);
+    }
+
+    Handle lens = Scene_AddLens(scene, &(Line) {
+        .start = { 300, 150 },
+        .end = { 300, 650 }
+    }, 300);
+    Scene_SetDispersion(scene, lens, LENS_DISPERSION);
+
+    lens = Scene_AddLens(scene, &(Line) {
+        .start = { 800, 150 },
+        .end = { 800, 650 }
+    }, 200);
+    Scene_SetDispersion(scene, lens, LENS_DISPERSION);
+
+    Scene_AddMirror(scene, &(Line) {
+        .start = { 1000, 100 },
+        .end = { 1100, 700 }
+    });
+}
+
+// Two facing mirrors that would trap rays forever without a bounce limit.
+void test_cavity(Scene *scene) {
+    for (i32 i = 0; i < 8; i++) {
+        *List_Push(&scene->light_rays, &scene->arena) = Ray_FromAngle((Vector2) { 600, 250 + 40 * i }, 0.05 * i);
     }
 
-    *List_Push(lenses, arena) = (Lens) {
-        .focal_length = 300,
-        .line = {
-            .start = { 500, 100 },
-            .end = { 500, 700 },
-        }
-    };
+    Scene_AddMirror(scene, &(Line) {
+        .start = { 300, 100 },
+        .end = { 300, 700 }
+    });
+
+    Scene_AddMirror(scene, &(Line) {
+        .start = { 900, 100 },
+        .end = { 900, 700 }
+    });
 }
 
-void test_lens_2(Rays *light_rays, Lenses *lenses, Arena *arena) {
-    *List_Push(light_rays, arena) = (Ray) {
-        .start = { 200, 200 },
-        .angle = 0
-    };
-
-    *List_Push(lenses, arena) = (Lens) {
-        .focal_length = 300,
-        .line = {
-            .start = { 500, 100 },
-            .end = { 500, 700 },
-        }
-    };
-
-    *List_Push(lenses, arena) = (Lens) {
-        .focal_length = 300,
-        .line = {
-            .start = { 700, 100 },
-            .end = { 700, 700 },
-        }
-    };
+// Sources and nothing for their light to hit.
+void test_lights(Scene *scene) {
+    Scene_AddPointLight(scene, &(Vector2) { 400, 400 });
+    Scene_AddLineLight(scene, &(Line) {
+        .start = { 800, 300 },
+        .end = { 800, 500 }
+    });
 }
 
-void test_update_setup(Rays *light_rays, PointLights *point_lights, Lenses *lenses, Arena *arena) {
+static Handle test_update_light;
+
+void test_update_setup(Scene *scene) {
     Vector2 position = { 600, 400 };
-    PointLights_Add(point_lights, light_rays, &position, arena);
-
-    *List_Push(lenses, arena) = (Lens) {
-        .line = {
-            .start = { 900, 200 },
-            .end = { 900, 600 }
-        },
-        .focal_length = 200
-    };
+    test_update_light = Scene_AddPointLight(scene, &position);
+
+    Scene_AddLens(scene, &(Line) {
+        .start = { 900, 200 },
+        .end = { 900, 600 }
+    }, 200);
 }
 
-void test_update_main(Rays *light_rays, PointLights *point_lights) {
+void test_update_main(Scene *scene) {
     f32 time = GetTime();
     Vector2 position = { 600 + 200 * cos(time), 400 + 200 * sin(time) };
+    // does nothing once the light is removed
+    Scene_MovePointLight(scene, test_update_light, &position);
+}
+
+// Generated scenes, for benchmarks and regression tests: `size` components
+// and `rays` rays, laid out from `random`.
+typedef void (*TestScene)(Scene *scene, usize size, usize rays, Random *random);
+
+static Line test_random_line(Random *random, f32 length) {
+    Vector2 start = { WIDTH * Random_F32(random), HEIGHT * Random_F32(random) };
+    f32 angle = 2 * PI * Random_F32(random);
+    return (Line) { start, { start.x + length * cosf(angle), start.y + length * sinf(angle) } };
+}
+
+// Short mirrors scattered over the screen, lit from the center.
+void test_random_mirrors(Scene *scene, usize size, usize rays, Random *random) {
+    for (usize i = 0; i < size; i++) {
+        Line line = test_random_line(random, 10 + 40 * Random_F32(random));
+        Scene_AddMirror(scene, &line);
+    }
+    for (usize i = 0; i < rays; i++) {
+        *List_Push(&scene->light_rays, &scene->arena) = Ray_FromAngle((Vector2) { WIDTH / 2.0, HEIGHT / 2.0 }, 2 * PI * i / rays);
+    }
+}
+
+// A row of parallel lenses with a collimated beam passing through all of them.
+void test_lens_stack(Scene *scene, usize size, usize rays, Random *random) {
+    for (usize i = 0; i < size; i++) {
+        f32 x = 100 + (WIDTH - 200) * (i + 0.5f) / size;
+        Scene_AddLens(scene, &(Line) { { x, 100 }, { x, HEIGHT - 100 } }, 100 + 400 * Random_F32(random));
+    }
+    for (usize i = 0; i < rays; i++) {
+        *List_Push(&scene->light_rays, &scene->arena) = Ray_FromAngle((Vector2) { 50, 150 + (HEIGHT - 300) * (i + 0.5f) / rays }, 0);
+    }
+}
+
+// Two facing walls of mirror facets, so most rays bounce until cut off.
+void test_faceted_cavity(Scene *scene, usize size, usize rays, Random *random) {
+    usize facets = size / 2 > 0 ? size / 2 : 1;
+    for (usize i = 0; i < facets; i++) {
+        f32 y_0 = 100 + (HEIGHT - 200) * (f32) i / facets;
+        f32 y_1 = 100 + (HEIGHT - 200) * (f32) (i + 1) / facets;
+        Scene_AddMirror(scene, &(Line) { { 200, y_0 }, { 200, y_1 } });
+        Scene_AddMirror(scene, &(Line) { { WIDTH - 200, y_0 }, { WIDTH - 200, y_1 } });
+    }
+    for (usize i = 0; i < rays; i++) {
+        Vector2 start = { WIDTH / 2.0, 150 + (HEIGHT - 300) * Random_F32(random) };
+        *List_Push(&scene->light_rays, &scene->arena) = Ray_FromAngle(start, 0.2f * (Random_F32(random) - 0.5f));
+    }
+}
+
+// Mirrors and lenses mixed, lit by point and line sources.
+void test_mixed(Scene *scene, usize size, usize rays, Random *random) {
+    for (usize i = 0; i < size; i++) {
+        Line line = test_random_line(random, 20 + 80 * Random_F32(random));
+        if (i % 3 == 0) Scene_AddLens(scene, &line, 50 + 300 * Random_F32(random));
+        else Scene_AddMirror(scene, &line);
+    }
+    for (usize i = 0; i * POINT_SOURCE_RAY_NUMBER < rays / 2; i++) {
+        Vector2 position = { WIDTH * Random_F32(random), HEIGHT * Random_F32(random) };
+        Scene_AddPointLight(scene, &position);
+    }
+    Line line = test_random_line(random, LINE_SOURCE_RAY_DISTANCE * rays / 2.0f);
+    Scene_AddLineLight(scene, &line);
+}
+
+// A wide collimated beam, like a line light's but denser, falling on long
+// mirrors scattered over the screen, so whole runs of rays bounce off the same
+// mirrors together.
+void test_beam(Scene *scene, usize size, usize rays, Random *random) {
+    for (usize i = 0; i < size; i++) {
+        Line line = test_random_line(random, 20 + 100 * Random_F32(random));
+        Scene_AddMirror(scene, &line);
+    }
+    for (usize i = 0; i < rays; i++) {
+        *List_Push(&scene->light_rays, &scene->arena) = Ray_FromAngle((Vector2) { 10, 50 + (HEIGHT - 100) * (i + 0.5f) / rays }, 0.3f);
+    }
+}
+
+typedef struct {
+    char *name;
+    TestScene generate;
+} TestSceneEntry;
+
+TestSceneEntry TEST_SCENES[] = {
+    { "random_mirrors", test_random_mirrors },
+    { "lens_stack", test_lens_stack },
+    { "faceted_cavity", test_faceted_cavity },
+    { "mixed", test_mixed },
+    { "beam", test_beam }
+};
+const usize TEST_SCENE_COUNT = sizeof(TEST_SCENES) / sizeof(*TEST_SCENES);
+
+// Loads one of the scenes above by name, for runs without a window. Returns
+// false if no scene has that name.
+bool test_load(Scene *scene, char *name) {
+    if (strcmp(name, "mirror") == 0) {
+        test_mirror(scene);
+    } else if (strcmp(name, "lens") == 0) {
+        test_lens(scene);
+    } else if (strcmp(name, "lens_2") == 0) {
+        test_lens_2(scene);
+    } else if (strcmp(name, "cavity") == 0) {
+        test_cavity(scene);
+    } else if (strcmp(name, "update") == 0) {
+        test_update_setup(scene);
+    } else if (strcmp(name, "dispersion") == 0) {
+        test_dispersion(scene);
+    } else if (strcmp(name, "lights") == 0) {
+        test_lights(scene);
+    } else {
+        return false;
+    }
 
-    PointLight *point_light = PointLights_Get(point_lights, 0);
-    PointLight_Update(point_light, light_rays, &position);
+    return true;
 }
@@ -0,0 +1,613 @@
+#pragma once
+
+#include "lib/types.c"
+#include "lib/arena.c"
+#include "lib/list.c"
+#include "lib/vectors.c"
+#include "lib/threads.c"
+
+#include "constants.c"
+#include "lines.c"
+#include "optics.c"
+#include "lights.c"
+#include "components.c"
+#include "spectrum.c"
+#include "bvh.c"
+#include "paraxial.c"
+#include "scene.c"
+
+// One traced segment, carrying the intensity and wavelength of the ray along
+// it. `component` is the slot (Handle.index) of the component the segment
+// ends on, which stays the same while the component exists, or
+// TRACE_NO_COMPONENT if the ray escapes along it.
+typedef struct {
+    Line line;
+    f32 intensity;
+    u32 component;
+    f32 wavelength;
+} LightLine;
+
+typedef struct {
+    LightLine *data;
+    usize length;
+    usize capacity;
+} LightLines;
+
+LightLine *LightLines_Get(LightLines *light_lines, usize index) {
+    if (index < 0 || index >= light_lines->length) { raise(SIGTRAP); }
+    return light_lines->data + index;
+}
+
+// Why a ray stopped being traced. Free ray slots are TRACE_EMPTY.
+typedef enum {
+    TRACE_EMPTY,
+    TRACE_ESCAPED,
+    TRACE_MAX_BOUNCES,
+    TRACE_MIN_INTENSITY
+} TraceEnd;
+
+// `intersection_tests` counts ray/segment tests in closest-hit queries.
+typedef struct {
+    usize rays;
+    usize segments;
+    usize bounces;
+    usize intersection_tests;
+    usize bounce_cutoffs;
+    usize intensity_cutoffs;
+} TraceStats;
+
+void TraceStats_Add(TraceStats *stats, TraceEnd end, usize segments) {
+    if (end == TRACE_EMPTY) return;
+    stats->rays++;
+    stats->segments += segments;
+    if (end == TRACE_MAX_BOUNCES) stats->bounce_cutoffs++;
+    if (end == TRACE_MIN_INTENSITY) stats->intensity_cutoffs++;
+}
+
+void TraceStats_Merge(TraceStats *stats, TraceStats *other) {
+    stats->rays += other->rays;
+    stats->segments += other->segments;
+    stats->bounces += other->bounces;
+    stats->intersection_tests += other->intersection_tests;
+    stats->bounce_cutoffs += other->bounce_cutoffs;
+    stats->intensity_cutoffs += other->intensity_cutoffs;
+}
+
+static TraceEnd trace_finish(TraceStats *stats, TraceEnd end, usize segments, usize bounces, usize tests) {
+    TraceStats_Add(stats, end, segments);
+    stats->bounces += bounces;
+    stats->intersection_tests += tests;
+    return end;
+}
+
+// A ray waiting to be traced after a white ray split, with the bounces it
+// has taken and the intensity its cutoff is relative to.
+typedef struct {
+    Ray ray;
+    u32 bounces;
+    f32 reference;
+} TraceBranch;
+
+// Splits the white `ray` leaving `component` at `point` into one ray per
+// spectrum sample. The first sample continues as `ray`, the rest are queued
+// in `branches`.
+static void trace_split(Ray *ray, Component *component, Vector2 *point, u32 bounces, f32 reference, TraceBranch *branches, u32 *pending) {
+    for (u32 k = SPECTRUM_SAMPLES; k-- > 0;) {
+        Ray sample = *ray;
+        sample.wavelength = Spectrum_Sample(k);
+        sample.intensity /= SPECTRUM_SAMPLES;
+        Ray leaving = {
+            .direction = Component_Respond(component, &sample, point),
+            .start = *point,
+            .intensity = sample.intensity * component->throughput,
+            .wavelength = sample.wavelength
+        };
+        if (k == 0) *ray = leaving;
+        else branches[(*pending)++] = (TraceBranch) { leaving, bounces, reference / SPECTRUM_SAMPLES };
+    }
+}
+
+// The last segment of a ray that hits nothing more.
+static LightLine trace_escape(Ray *ray) {
+    Vector2 light_vector = Ray_ToVector(ray);
+    Vector2 scaled_vector = Vector2_Scale(&light_vector, LIGHT_RAY_LENGTH);
+    return (LightLine) {
+        .line = { .start = ray->start, .end = Vector2_Add(&ray->start, &scaled_vector) },
+        .intensity = ray->intensity,
+        .component = TRACE_NO_COMPONENT,
+        .wavelength = ray->wavelength
+    };
+}
+
+// Pushes a segment from `ray`, leaving the first lens of `run` as `entry`, to
+// each later lens of the run, and turns `ray` into the ray leaving the last
+// one as `exit`.
+static void trace_paraxial_segments(Scene *scene, ParaxialRun *run, ParaxialState *entry, ParaxialState *exit, Ray *ray, LightLines *light_lines, Arena *arena) {
+    Paraxial *paraxial = &scene->paraxial;
+    Vector2 start = ray->start;
+    f32 intensity = ray->intensity;
+    for (u32 k = 1; k < run->count; k++) {
+        ParaxialLens *lens = paraxial->lenses.data + run->first + k;
+        Vector2 point = ParaxialRun_Point(paraxial, run, k, entry);
+        *List_Push(light_lines, arena) = (LightLine) {
+            .line = { .start = start, .end = point },
+            .intensity = intensity,
+            .component = scene->component_handles.owners.data[lens->component],
+            .wavelength = ray->wavelength
+        };
+        start = point;
+        intensity *= lens->throughput;
+    }
+    *ray = (Ray) {
+        .direction = ParaxialRun_Direction(run, exit),
+        .start = start,
+        .intensity = intensity,
+        .wavelength = ray->wavelength
+    };
+}
+
+// Carries those of `count` rays that just left component `index` into a lens
+// run through the rest of it in one batch, pushing their segments to
+// `light_lines` one ray after the other, and sets how many lenses each passed
+// in `passed`. A ray is left to the exact tracer, with 0 passed, if the lens
+// runs are off, it doesn't head down the run, it would pass close to a lens
+// edge, or a cutoff would stop it partway. `bounces` and `references` are the
+// bounces each has taken and the intensity its cutoff is relative to.
+static void trace_paraxial(Scene *scene, usize index, Ray **rays, u32 count, u32 *bounces, f32 *references, u32 *passed, LightLines *light_lines, Arena *arena) {
+    if (count > TRACE_PACKET_SIZE) { raise(SIGTRAP); }
+    for (u32 r = 0; r < count; r++) passed[r] = 0;
+    ParaxialRun *run = scene->paraxial.enabled ? Paraxial_Run(&scene->paraxial, index) : NULL;
+    if (!run) return;
+
+    ParaxialState entries[TRACE_PACKET_SIZE];
+    ParaxialState states[TRACE_PACKET_SIZE];
+    bool inside[TRACE_PACKET_SIZE];
+    u32 batch[TRACE_PACKET_SIZE];
+    u32 size = 0;
+    for (u32 r = 0; r < count; r++) {
+        Ray *ray = rays[r];
+        if (!ParaxialRun_Enters(run, ray)) continue;
+        if (bounces[r] + run->count - 1 > scene->options.max_bounces) continue;
+        if (ray->intensity * run->transmission < references[r] * scene->options.min_intensity) continue;
+        entries[size] = states[size] = ParaxialRun_Enter(run, ray);
+        batch[size++] = r;
+    }
+    ParaxialRun_Propagate(&scene->paraxial, run, states, size, inside);
+
+    for (u32 j = 0; j < size; j++) {
+        if (!inside[j]) continue;
+        trace_paraxial_segments(scene, run, entries + j, states + j, rays[batch[j]], light_lines, arena);
+        passed[batch[j]] = run->count - 1;
+    }
+}
+
+// Traces `branch` and then each of the `pending` branches queued in
+// `branches`, which has room for SPECTRUM_SAMPLES, adding to `bounces` and
+// `tests`. Returns the first cutoff any of them hit, or TRACE_ESCAPED.
+static TraceEnd trace_branches(Scene *scene, TraceBranch branch, TraceBranch *branches, u32 pending, LightLines *light_lines, u32 *bounces, usize *tests, Arena *arena) {
+    TraceEnd end = TRACE_ESCAPED;
+    for (;;) {
+        Ray ray = branch.ray;
+        TraceEnd branch_end = TRACE_ESCAPED;
+        Hit hit;
+        while (ray.intensity >= branch.reference * scene->options.min_intensity) {
+            bool found = Scene_Closest(scene, &ray, &hit);
+            *tests += hit.tests;
+            if (!found) break;
+
+            *List_Push(light_lines, arena) = (LightLine) {
+                .line = { .start = ray.start, .end = hit.point },
+                .intensity = ray.intensity,
+                .component = scene->component_handles.owners.data[hit.index],
+                .wavelength = ray.wavelength
+            };
+            if (branch.bounces == scene->options.max_bounces) {
+                branch_end = TRACE_MAX_BOUNCES;
+                break;
+            }
+
+            Component *component = Components_Get(&scene->components, hit.index);
+            branch.bounces++;
+            (*bounces)++;
+            if (ray.wavelength == 0 && component->kind == COMPONENT_LENS && component->dispersion != 0) {
+                trace_split(&ray, component, &hit.point, branch.bounces, branch.reference, branches, &pending);
+                branch.reference /= SPECTRUM_SAMPLES;
+                continue;
+            }
+            ray = (Ray) {
+                .direction = Component_Respond(component, &ray, &hit.point),
+                .start = hit.point,
+                .intensity = ray.intensity * component->throughput,
+                .wavelength = ray.wavelength
+            };
+
+            u32 passed;
+            trace_paraxial(scene, hit.index, &(Ray *) { &ray }, 1, &branch.bounces, &branch.reference, &passed, light_lines, arena);
+            branch.bounces += passed;
+            *bounces += passed;
+        }
+
+        if (branch_end == TRACE_ESCAPED && ray.intensity < branch.reference * scene->options.min_intensity) {
+            branch_end = TRACE_MIN_INTENSITY;
+        } else if (branch_end == TRACE_ESCAPED) {
+            // add in the rest of the ray
+            *List_Push(light_lines, arena) = trace_escape(&ray);
+        }
+        if (end == TRACE_ESCAPED) end = branch_end;
+
+        if (pending == 0) break;
+        branch = branches[--pending];
+    }
+    return end;
+}
+
+// Follows a single ray through every component it hits, pushing one
+// `LightLine` per traversed segment into `light_lines`, until it escapes, has
+// bounced `max_bounces` times or has dropped below `min_intensity` of the
+// intensity it started with, and adds the work to `stats`. Expects
+// the scene's accelerator to be up to date.
+//
+// A white ray is traced as one until it reaches a dispersive lens, where it
+// splits into SPECTRUM_SAMPLES rays that are traced one after the other, each
+// as its own run of segments. The end reported is the first cutoff any of
+// them hit, or TRACE_ESCAPED.
+TraceEnd trace_ray(Scene *scene, Ray *light_ray, LightLines *light_lines, TraceStats *stats, Arena *arena) {
+    if (light_ray->intensity <= 0) return TRACE_EMPTY;
+
+    TraceBranch branches[SPECTRUM_SAMPLES];
+    u32 bounces = 0;
+    usize tests = 0;
+    usize first = light_lines->length;
+    TraceBranch branch = { *light_ray, 0, light_ray->intensity };
+    TraceEnd end = trace_branches(scene, branch, branches, 0, light_lines, &bounces, &tests, arena);
+    return trace_finish(stats, end, light_lines->length - first, bounces, tests);
+}
+
+typedef struct {
+    u32 *data;
+    usize length;
+    usize capacity;
+} TraceMembers;
+
+// Memory trace_packet reuses from one packet to the next: the packet's
+// segments in the order they were traced, with the ray each belongs to, and
+// room for a caller that keeps every ray's segments apart to put them.
+typedef struct {
+    LightLines lines;
+    TraceMembers members;
+    LightLines paths;
+} TracePacketScratch;
+
+// One ray of a packet, as far as it has been traced. `bounces` counts every
+// bounce, including those of the colors it split into.
+typedef struct {
+    Ray ray;
+    u32 bounces;
+    f32 reference;
+    usize tests;
+    TraceEnd end;
+} TraceMember;
+
+// Whether `b` can go in a packet led by `a`: both are lit, have the same
+// wavelength and head the same way to within TRACE_PACKET_SPREAD, like the
+// rays of a line light.
+bool trace_coherent(Ray *a, Ray *b) {
+    return a->intensity > 0 && b->intensity > 0 && a->wavelength == b->wavelength
+        && fabsf(a->direction.x - b->direction.x) + fabsf(a->direction.y - b->direction.y) <= TRACE_PACKET_SPREAD;
+}
+
+static void trace_packet_push(TracePacketScratch *scratch, u32 member, LightLine light_line, Arena *arena) {
+    *List_Push(&scratch->lines, arena) = light_line;
+    *List_Push(&scratch->members, arena) = member;
+}
+
+// Traces the rest of member `m` on its own, from `branch` and the `pending`
+// branches a split queued in `branches`.
+static void trace_packet_alone(Scene *scene, TraceMember *member, u32 m, TraceBranch branch, TraceBranch *branches, u32 pending, TracePacketScratch *scratch, Arena *arena) {
+    usize first = scratch->lines.length;
+    member->end = trace_branches(scene, branch, branches, pending, &scratch->lines, &member->bounces, &member->tests, arena);
+    for (usize i = first; i < scratch->lines.length; i++) *List_Push(&scratch->members, arena) = m;
+}
+
+// Traces up to TRACE_PACKET_SIZE rays that lead with `rays[0]` as in
+// trace_coherent, with the same results as trace_ray on each. The rays go a
+// bounce at a time through Scene_ClosestPacket, so the accelerator is walked
+// once for all of them. After each bounce the packet splits by the component
+// each ray hit, and a part goes on as a packet while its rays still head the
+// same way, as after a mirror. The rest, such as rays focused by a lens or
+// split into colors, are traced on alone.
+//
+// Appends each ray's segments to `light_lines`, one ray after the other, and
+// sets how many each got in `counts` and why it stopped in `ends`.
+void trace_packet(Scene *scene, Ray **rays, u32 count, u32 *counts, TraceEnd *ends, LightLines *light_lines, TracePacketScratch *scratch, TraceStats *stats, Arena *arena) {
+    if (count > TRACE_PACKET_SIZE) { raise(SIGTRAP); }
+    scratch->lines.length = 0;
+    scratch->members.length = 0;
+
+    TraceMember members[TRACE_PACKET_SIZE];
+    TraceBranch branches[SPECTRUM_SAMPLES];
+    // packets still to trace are ranges of `order`, kept on a stack
+    u32 order[TRACE_PACKET_SIZE];
+    u32 firsts[TRACE_PACKET_SIZE];
+    u32 sizes[TRACE_PACKET_SIZE];
+    u32 top = 0;
+
+    u32 lit = 0;
+    for (u32 m = 0; m < count; m++) {
+        members[m] = (TraceMember) { .ray = *rays[m], .reference = rays[m]->intensity, .end = TRACE_EMPTY };
+        if (rays[m]->intensity > 0) order[lit++] = m;
+    }
+    if (lit > 0) {
+        firsts[top] = 0;
+        sizes[top++] = lit;
+    }
+
+    while (top > 0) {
+        top--;
+        u32 *group = order + firsts[top];
+        u32 size = sizes[top];
+
+        // rays below the cutoff stop before the query
+        Ray *queries[TRACE_PACKET_SIZE];
+        Hit hits[TRACE_PACKET_SIZE];
+        u32 live = 0;
+        for (u32 k = 0; k < size; k++) {
+            TraceMember *member = members + group[k];
+            if (member->ray.intensity < member->reference * scene->options.min_intensity) {
+                member->end = TRACE_MIN_INTENSITY;
+                continue;
+            }
+            group[live] = group[k];
+            queries[live++] = &member->ray;
+        }
+        Scene_ClosestPacket(scene, queries, live, hits);
+
+        // bounce every ray, keeping the ones that go on sorted by the
+        // component they hit
+        usize slots[TRACE_PACKET_SIZE];
+        u32 moving = 0;
+        for (u32 k = 0; k < live; k++) {
+            u32 m = group[k];
+            TraceMember *member = members + m;
+            Ray *ray = &member->ray;
+            Hit *hit = hits + k;
+            member->tests += hit->tests;
+            if (hit->kind == COMPONENT_NONE) {
+                trace_packet_push(scratch, m, trace_escape(ray), arena);
+                member->end = TRACE_ESCAPED;
+                continue;
+            }
+
+            trace_packet_push(scratch, m, (LightLine) {
+                .line = { .start = ray->start, .end = hit->point },
+                .intensity = ray->intensity,
+                .component = scene->component_handles.owners.data[hit->index],
+                .wavelength = ray->wavelength
+            }, arena);
+            if (member->bounces == scene->options.max_bounces) {
+                member->end = TRACE_MAX_BOUNCES;
+                continue;
+            }
+
+            Component *component = Components_Get(&scene->components, hit->index);
+            member->bounces++;
+            if (ray->wavelength == 0 && component->kind == COMPONENT_LENS && component->dispersion != 0) {
+                u32 pending = 0;
+                trace_split(ray, component, &hit->point, member->bounces, member->reference, branches, &pending);
+                TraceBranch branch = { *ray, member->bounces, member->reference / SPECTRUM_SAMPLES };
+                trace_packet_alone(scene, member, m, branch, branches, pending, scratch, arena);
+                continue;
+            }
+            *ray = (Ray) {
+                .direction = Component_Respond(component, ray, &hit->point),
+                .start = hit->point,
+                .intensity = ray->intensity * component->throughput,
+                .wavelength = ray->wavelength
+            };
+
+            // never writes past `k`, so the rays still to come stay put
+            u32 j = moving++;
+            while (j > 0 && slots[j - 1] > hit->index) {
+                group[j] = group[j - 1];
+                slots[j] = slots[j - 1];
+                j--;
+            }
+            group[j] = m;
+            slots[j] = hit->index;
+        }
+
+        // every run of rays off one component goes through the lens run it
+        // starts, if any, and then on as a packet with those that still head
+        // the same way as its first ray
+        for (u32 run = 0; run < moving;) {
+            u32 end = run + 1;
+            while (end < moving && slots[end] == slots[run]) end++;
+
+            if (scene->paraxial.enabled) {
+                Ray *batch[TRACE_PACKET_SIZE];
+                u32 bounces[TRACE_PACKET_SIZE];
+                f32 references[TRACE_PACKET_SIZE];
+                u32 passed[TRACE_PACKET_SIZE];
+                for (u32 k = run; k < end; k++) {
+                    TraceMember *member = members + group[k];
+                    batch[k - run] = &member->ray;
+                    bounces[k - run] = member->bounces;
+                    references[k - run] = member->reference;
+                }
+                trace_paraxial(scene, slots[run], batch, end - run, bounces, references, passed, &scratch->lines, arena);
+                for (u32 k = run; k < end; k++) {
+                    members[group[k]].bounces += passed[k - run];
+                    for (u32 i = 0; i < passed[k - run]; i++) *List_Push(&scratch->members, arena) = group[k];
+                }
+            }
+
+            Ray *lead = &members[group[run]].ray;
+            u32 kept = run;
+            for (u32 k = run; k < end; k++) {
+                TraceMember *member = members + group[k];
+                if (trace_coherent(lead, &member->ray)) {
+                    group[kept++] = group[k];
+                    continue;
+                }
+                TraceBranch branch = { member->ray, member->bounces, member->reference };
+                trace_packet_alone(scene, member, group[k], branch, branches, 0, scratch, arena);
+            }
+
+            if (kept - run == 1) {
+                TraceMember *member = members + group[run];
+                TraceBranch branch = { member->ray, member->bounces, member->reference };
+                trace_packet_alone(scene, member, group[run], branch, branches, 0, scratch, arena);
+            } else {
+                firsts[top] = group + run - order;
+                sizes[top++] = kept - run;
+            }
+            run = end;
+        }
+    }
+
+    // gather each ray's segments, which are in path order, into one run
+    usize offsets[TRACE_PACKET_SIZE];
+    for (u32 m = 0; m < count; m++) counts[m] = 0;
+    for (usize i = 0; i < scratch->members.length; i++) counts[scratch->members.data[i]]++;
+    usize total = light_lines->length;
+    for (u32 m = 0; m < count; m++) {
+        offsets[m] = total;
+        total += counts[m];
+    }
+    List_Reserve(light_lines, total, arena);
+    for (usize i = 0; i < scratch->lines.length; i++) {
+        light_lines->data[offsets[scratch->members.data[i]]++] = scratch->lines.data[i];
+    }
+    light_lines->length = total;
+
+    for (u32 m = 0; m < count; m++) {
+        ends[m] = trace_finish(stats, members[m].end, counts[m], members[m].bounces, members[m].tests);
+    }
+}
+
+// Traces every ray in the scene, appending the results to `light_lines`.
+void trace_scene(Scene *scene, LightLines *light_lines, TraceStats *stats, Arena *arena) {
+    Scene_UpdateAccelerator(scene);
+    for (usize i = 0; i < scene->light_rays.length; i++) {
+        trace_ray(scene, Rays_Get(&scene->light_rays, i), light_lines, stats, arena);
+    }
+}
+
+// Where one ray's segments ended up in a worker's buffer.
+typedef struct {
+    u32 worker;
+    u32 first;
+    u32 count;
+} TraceSpan;
+
+// Traces rays on every core. Each worker writes into its own buffer and arena,
+// and the results are merged back in ray order, so the output is the same as
+// trace_scene no matter how the rays were scheduled. With `packets` set, runs
+// of consecutive coherent rays are traced together by trace_packet.
+typedef struct {
+    ThreadPool pool;
+    Arena arena;
+    Arena *arenas;
+    LightLines *buffers;
+    TraceStats *stats;
+    TracePacketScratch *scratches;
+    bool packets;
+    TraceSpan *spans;
+    usize span_capacity;
+    Scene *scene;
+    Rays *light_rays;
+} Tracer;
+
+void Tracer_Init(Tracer *tracer, usize workers, Arena *arena) {
+    *tracer = (Tracer) { 0 };
+    ThreadPool_Init(&tracer->pool, workers, arena);
+    tracer->arenas = Arena_Alloc(arena, Arena, tracer->pool.count);
+    tracer->buffers = Arena_Alloc(arena, LightLines, tracer->pool.count);
+    tracer->stats = Arena_Alloc(arena, TraceStats, tracer->pool.count);
+    tracer->scratches = Arena_Alloc(arena, TracePacketScratch, tracer->pool.count);
+    tracer->packets = true;
+    for (usize i = 0; i < tracer->pool.count; i++) {
+        tracer->arenas[i] = Arena_New(TRACE_ARENA_CAPACITY);
+    }
+
+    // pick the kernel up front instead of racing on it from the workers
+    Segments_Kernel();
+}
+
+void Tracer_Free(Tracer *tracer) {
+    ThreadPool_Free(&tracer->pool);
+    for (usize i = 0; i < tracer->pool.count; i++) Arena_Free(tracer->arenas + i);
+    Arena_Free(&tracer->arena);
+}
+
+static void Tracer_TraceChunk(void *context, usize chunk, usize worker) {
+    Tracer *tracer = context;
+    Rays *light_rays = tracer->light_rays;
+    LightLines *buffer = tracer->buffers + worker;
+
+    TraceStats *stats = tracer->stats + worker;
+    Arena *arena = tracer->arenas + worker;
+
+    usize first = chunk * TRACE_CHUNK_SIZE;
+    usize last = first + TRACE_CHUNK_SIZE < light_rays->length ? first + TRACE_CHUNK_SIZE : light_rays->length;
+    for (usize i = first; i < last;) {
+        Ray *rays[TRACE_PACKET_SIZE] = { Rays_Get(light_rays, i) };
+        u32 count = 1;
+        while (tracer->packets && count < TRACE_PACKET_SIZE && i + count < last && trace_coherent(rays[0], light_rays->data + i + count)) {
+            rays[count] = light_rays->data + i + count;
+            count++;
+        }
+
+        usize start = buffer->length;
+        if (count == 1) {
+            trace_ray(tracer->scene, rays[0], buffer, stats, arena);
+            tracer->spans[i++] = (TraceSpan) { .worker = worker, .first = start, .count = buffer->length - start };
+            continue;
+        }
+
+        u32 counts[TRACE_PACKET_SIZE];
+        TraceEnd ends[TRACE_PACKET_SIZE];
+        trace_packet(tracer->scene, rays, count, counts, ends, buffer, tracer->scratches + worker, stats, arena);
+        for (u32 m = 0; m < count; m++) {
+            tracer->spans[i++] = (TraceSpan) { .worker = worker, .first = start, .count = counts[m] };
+            start += counts[m];
+        }
+    }
+}
+
+// Traces `light_rays` through the components of `scene` instead of the scene's
+// own rays, appending the results to `light_lines`.
+void Tracer_TraceRays(Tracer *tracer, Scene *scene, Rays *light_rays, LightLines *light_lines, TraceStats *stats, Arena *arena) {
+    Scene_UpdateAccelerator(scene);
+
+    usize ray_count = light_rays->length;
+    if (ray_count > tracer->span_capacity) {
+        tracer->span_capacity = 2 * ray_count;
+        tracer->spans = Arena_Alloc(&tracer->arena, TraceSpan, tracer->span_capacity);
+    }
+    for (usize i = 0; i < tracer->pool.count; i++) {
+        tracer->buffers[i].length = 0;
+        tracer->stats[i] = (TraceStats) { 0 };
+    }
+
+    tracer->scene = scene;
+    tracer->light_rays = light_rays;
+    usize chunks = (ray_count + TRACE_CHUNK_SIZE - 1) / TRACE_CHUNK_SIZE;
+    ThreadPool_Run(&tracer->pool, chunks, Tracer_TraceChunk, tracer);
+    for (usize i = 0; i < tracer->pool.count; i++) TraceStats_Merge(stats, tracer->stats + i);
+
+    usize total = light_lines->length;
+    for (usize i = 0; i < ray_count; i++) total += tracer->spans[i].count;
+    List_Reserve(light_lines, total, arena);
+
+    for (usize i = 0; i < ray_count; i++) {
+        TraceSpan *span = tracer->spans + i;
+        memcpy(light_lines->data + light_lines->length, tracer->buffers[span->worker].data + span->first, span->count * sizeof(LightLine));
+        light_lines->length += span->count;
+    }
+}
+
+// Parallel version of trace_scene, appending the results to `light_lines`.
+void Tracer_Trace(Tracer *tracer, Scene *scene, LightLines *light_lines, TraceStats *stats, Arena *arena) {
+    Tracer_TraceRays(tracer, scene, &scene->light_rays, light_lines, stats, arena);
+}